@@ -0,0 +1,126 @@
+#ifndef PFW_BASIC_WATCHER_H
+#define PFW_BASIC_WATCHER_H
+
+#include <algorithm>
+#include <concepts>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "fw/Filter.h"
+#include "fw/InotifyService.h"
+
+/// BasicWatcher 的策略。过滤策略逐个判断事件是否投递；合并策略 builtin 为 true 时沿用 Collector
+/// 内置的按路径状态机合并，为 false 时 Collector 原样交出批次，由策略自己处理
+namespace policy {
+struct AcceptAll {
+  bool operator()(const Event&) const noexcept { return true; }
+};
+
+/// 只投递 mask 中任一位被置位的事件，FAILED 总是投递
+template <EventType Mask>
+struct AcceptTypes {
+  bool operator()(const Event& event) const noexcept {
+    return (event.type & (Mask | FAILED)) != NONE;
+  }
+};
+
+struct StateMachineCoalescing {
+  static constexpr bool builtin = true;
+  void operator()(std::vector<Event::uptr>&) const noexcept {}
+};
+
+struct NoCoalescing {
+  static constexpr bool builtin = false;
+  void operator()(std::vector<Event::uptr>&) const noexcept {}
+};
+}
+
+template <typename FilterPolicy>
+concept FilterPolicyConcept = requires(FilterPolicy filter, const Event& event)
+{
+  { filter(event) } -> std::convertible_to<bool>;
+};
+
+template <typename CoalescePolicy>
+concept CoalescePolicyConcept = requires(CoalescePolicy coalesce, std::vector<Event::uptr>& events)
+{
+  { CoalescePolicy::builtin } -> std::convertible_to<bool>;
+  coalesce(events);
+};
+
+/// 单消费者的投递路径：回调与策略按值保存，Collector 每批只经过一次函数指针调用，
+/// 之后的合并、过滤与回调全部可以内联，没有监听器表、互斥锁和 std::function
+template <CallbackConcept Callback,
+          FilterPolicyConcept FilterPolicy = policy::AcceptAll,
+          CoalescePolicyConcept CoalescePolicy = policy::StateMachineCoalescing>
+class BasicDelivery {
+public:
+  explicit BasicDelivery(Callback callback,
+                         FilterPolicy filter = FilterPolicy{},
+                         CoalescePolicy coalesce = CoalescePolicy{})
+    : mCallback(std::move(callback))
+      , mFilter(std::move(filter))
+      , mCoalesce(std::move(coalesce)) {}
+
+  BasicDelivery(const BasicDelivery&) = delete;
+  BasicDelivery& operator=(const BasicDelivery&) = delete;
+
+  /// 返回的 Filter 持有 this，必须在本对象之前销毁。Collector 从中取出 sink 直接调用，
+  /// 不经过 Filter 的订阅表与监听器表
+  Filter::sptr makeFilter() {
+    return std::make_shared<Filter>(&BasicDelivery::deliver, this);
+  }
+
+  void operator()(std::vector<Event::uptr>&& events) {
+    if constexpr (!CoalescePolicy::builtin) {
+      mCoalesce(events);
+    }
+    std::erase_if(events, [this](const Event::uptr& event) { return !mFilter(*event); });
+    if (events.empty()) { return; }
+    mCallback(std::move(events));
+  }
+
+private:
+  static void deliver(void* context, std::vector<Event::uptr>&& events) {
+    (*static_cast<BasicDelivery*>(context))(std::move(events));
+  }
+
+  Callback mCallback;
+  [[no_unique_address]] FilterPolicy mFilter;
+  [[no_unique_address]] CoalescePolicy mCoalesce;
+};
+
+/// 基于策略的监听器：与 InotifyService 相同的后端，投递路径换成 BasicDelivery
+template <CallbackConcept Callback,
+          FilterPolicyConcept FilterPolicy = policy::AcceptAll,
+          CoalescePolicyConcept CoalescePolicy = policy::StateMachineCoalescing>
+class BasicWatcher {
+public:
+  using Delivery = BasicDelivery<Callback, FilterPolicy, CoalescePolicy>;
+
+  BasicWatcher(const fs::path& path,
+               std::chrono::milliseconds latency,
+               Callback callback,
+               WatchOptions options = {},
+               FilterPolicy filter = FilterPolicy{},
+               CoalescePolicy coalesce = CoalescePolicy{})
+    : mDelivery(std::move(callback), std::move(filter), std::move(coalesce)) {
+    options.coalesceEvents = CoalescePolicy::builtin;
+    mService = std::make_unique<InotifyService>(mDelivery.makeFilter(), path, latency, options);
+  }
+
+  bool isWatching() const { return mService->isWatching(); }
+  bool isReady() const { return mService->isReady(); }
+
+  ~BasicWatcher() {
+    /// 先停掉 Collector 线程，再销毁它回调的 mDelivery
+    mService.reset();
+  }
+
+private:
+  Delivery mDelivery;
+  std::unique_ptr<InotifyService> mService;
+};
+
+#endif
@@ -14,33 +14,90 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
 
 #include "fw/Filter.h"
+#include "fw/ConsistencyAuditor.h"
+#include "fw/EventAggregator.h"
+#include "fw/EventJournal.h"
+#include "fw/IdentityTracker.h"
+#include "fw/TailTracker.h"
 
 class Collector {
 public:
   using sptr = std::shared_ptr<Collector>;
   using ptr = Collector*;
 
-  Collector(const Filter::sptr& filter, std::chrono::milliseconds sleepDuration);
+  Collector(const Filter::sptr& filter, std::chrono::milliseconds sleepDuration,
+            std::size_t initChunkSize = 1024,
+            std::size_t aggregationThreshold = 0,
+            std::chrono::milliseconds aggregationWindow = std::chrono::milliseconds(1000),
+            bool coalesceEvents = true,
+            bool threaded = true);
   ~Collector();
 
+  /// 实时事件按收入顺序组成一个流，timePoint 在持有输入锁时打上，因此与流中的顺序一致（时钟不回拨时非递减）；
+  /// 初始扫描车道单独排队，其事件的 timePoint 与实时流之间没有这一关系
   void insert(std::vector<Event::uptr>&& events);
   void collect(EventType type, const fs::path& relativePath);
+  /// 初始扫描车道：不参与合并，每个周期在实时事件之后最多投递 initChunkSize 个，只取该周期实时批次取走之前排队的
+  void collectInit(const fs::path& relativePath);
+  void completeInitScan(const fs::path& subtree);
+
+  /// 开启追踪模式，relativePath 相对 root；遍历时由 InotifyTree 调用 seedTail 记录已有文件大小
+  void enableTailing(const fs::path& root, const std::vector<std::string>& patterns);
+  void seedTail(const fs::path& relativePath);
+  /// 开启文件身份，遍历时由 InotifyTree 调用 seedIdentity 记录已有文件与目录的身份
+  void enableIdentity(const fs::path& root);
+  void seedIdentity(const fs::path& relativePath, const FileId& id);
+  /// 投递前把每批事件追加到 journal（接管其所有权）。只能设置一次，重复调用时删除传入的 journal 并返回 false
+  bool enableJournal(EventJournal::ptr journal);
+  /// 每个投递的批次同时交给 auditor 重建视图（接管其所有权）。只能设置一次，规则同 enableJournal
+  bool enableAudit(ConsistencyAuditor::ptr auditor);
 
   void sendEvents();
-  void sendError(const std::string& errorMsg) const;
+  /// 无线程模式（threaded == false）下队列由空变为非空时变为可读的 eventfd，其他模式为 -1
+  int wakeFd() const;
+  void wake() const;
+  /// 读空 wakeFd；此后若两条车道仍有事件则重新置为可读
+  void rearm();
+  /// 反复发送直到两条车道都为空
+  void flush();
+  /// 错误排入实时队列，与事件一样在投递线程上送出，任何线程都可以调用
+  void sendError(const std::string& errorMsg);
 
 private:
   // void stop();
   void work();
+  void journal(std::vector<Event::uptr>& events);
+  /// 直接投递模式下跳过 Filter，直接调用其 sink
+  void deliver(std::vector<Event::uptr>&& events) const;
+  void observe(const std::vector<Event::uptr>& events);
+  /// 初始扫描车道排在实时事件之后：实时批次投递前，把排队中更早产生、位于被改名或删除路径下的
+  /// 扫描结果改到新路径或丢弃（SCAN_COMPLETE 只改路径不丢弃）
+  void retarget(const std::vector<Event::uptr>& events);
+  /// 按路径运行状态机合并一个批次：创建+修改→创建，创建+删除→无，删除+创建→CHANGED|REPLACED；
+  /// 合并后的事件放在其含义最后一次改变的位置，重命名对保持相邻且不与前后事件合并
+  static void coalesce(std::vector<Event::uptr>& events);
 
   Filter::sptr mFilter;
+  const Filter::DirectSink mDirectSink;
+  void* const mSinkContext;
   std::chrono::milliseconds mSleepDuration;
   std::atomic<bool> mRunning;
   std::thread mRunner;
   std::mutex event_input_mutex;
   std::vector<Event::uptr> inputVector;
+  EventAggregator mAggregator;
+  TailTracker mTail;
+  IdentityTracker mIdentity;
+  std::atomic<EventJournal::ptr> mJournal;
+  std::atomic<ConsistencyAuditor::ptr> mAuditor;
+  int mWakeFd;
+  const std::size_t mInitChunkSize;
+  const bool mCoalesceEvents;
+  std::mutex init_input_mutex;
+  std::deque<Event::uptr> initQueue;
 };
 
 #endif //COLLECTOR_HH
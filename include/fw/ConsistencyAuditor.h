@@ -0,0 +1,111 @@
+#ifndef PFW_CONSISTENCY_AUDITOR_H
+#define PFW_CONSISTENCY_AUDITOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 不一致的来源
+enum class AuditCategory {
+  MISSED_CREATE,    /// 磁盘上有、视图中没有，父目录在视图中
+  MISSED_SUBTREE,   /// 磁盘上有、视图中没有，父目录也不在视图中（新目录的内容没有遍历到）
+  MISSED_DELETE,    /// 视图中有、磁盘上已没有
+  LOST_RENAME_HALF, /// 最后一个相关事件是没有配对的改名半边
+  OVERFLOW_RESYNC   /// 队列溢出后整树重新同步时的差异
+};
+
+const std::map<AuditCategory, std::string> auditCategoryToString = {
+  {AuditCategory::MISSED_CREATE, "漏报创建"},
+  {AuditCategory::MISSED_SUBTREE, "漏报子树"},
+  {AuditCategory::MISSED_DELETE, "漏报删除"},
+  {AuditCategory::LOST_RENAME_HALF, "改名半边丢失"},
+  {AuditCategory::OVERFLOW_RESYNC, "溢出重同步"}
+};
+
+/// 一次对账的结果。divergent 只统计连续两次对账都不一致、期间没有任何事件触及、
+/// 投递进度已越过首次发现时刻，且本次对账之前的整个间隔内没有任何投递（管线静止）的路径；
+/// 其余差异计入 pending。持续有事件投递时无法区分在途与丢失（各分片、各读取线程的进度不同），差异一直保持待定。
+/// 溢出后重新同步的差异只记在 OVERFLOW_RESYNC 类别下，不计入 divergent
+struct AuditReport {
+  std::size_t diskPaths{0};
+  std::size_t viewPaths{0};
+  std::size_t eventsObserved{0};
+  std::size_t overflows{0};
+  std::size_t pending{0};
+  std::size_t divergent{0};
+  /// divergent / diskPaths
+  double divergenceRate{0};
+  std::map<AuditCategory, std::size_t> categories;
+  std::vector<fs::path> samples;
+};
+
+/// 一致性审计。按投递的事件重建监听根目录下的路径集合，定期与文件系统的全新扫描对账，
+/// 报告丢失或错误的事件及其类别。SUBTREE_DIRTY 按约定重新扫描该子树，不计为差异；
+/// 附加在主根目录之外的路径（"../"）不参与审计
+class ConsistencyAuditor {
+public:
+  using ptr = ConsistencyAuditor*;
+  using Callback = std::function<void(const AuditReport&)>;
+
+  /// 构造时扫描一次作为基线；interval 大于 0 时在后台线程上定期对账并调用 callback
+  explicit ConsistencyAuditor(const fs::path& root,
+                              std::chrono::milliseconds interval = std::chrono::milliseconds(0),
+                              Callback callback = {});
+  ConsistencyAuditor(const ConsistencyAuditor&) = delete;
+  ConsistencyAuditor& operator=(const ConsistencyAuditor&) = delete;
+
+  void observe(const std::vector<Event::uptr>& events);
+  AuditReport audit();
+
+  ~ConsistencyAuditor();
+
+private:
+  static constexpr std::size_t MAX_SAMPLES = 16;
+  using Clock = std::chrono::high_resolution_clock;
+
+  struct Suspect {
+    AuditCategory category;
+    /// 首次发现差异的那次扫描的开始时刻
+    Clock::time_point since;
+  };
+
+  std::set<fs::path> scan() const;
+  void apply(const Event& event);
+  /// path 或其祖先在本轮扫描期间被事件触及
+  bool touched(const fs::path& path) const;
+  AuditCategory classify(const fs::path& path, bool onDisk) const;
+  void run();
+
+  const fs::path mRoot;
+  const std::chrono::milliseconds mInterval;
+  Callback mCallback;
+
+  std::mutex mAuditMutex;
+  std::set<fs::path> mView;
+  /// 自上次对账以来每个路径最后一个事件的类型
+  std::map<fs::path, EventType> mLastEvent;
+  std::set<fs::path> mTouched;
+  std::set<fs::path> mDirtySubtrees;
+  /// 尚未确认的差异
+  std::map<fs::path, Suspect> mSuspects;
+  /// 已投递事件中最新的 Event::timePoint，用来判断管线是否已经追上某次扫描
+  Clock::time_point mWatermark;
+  std::size_t mEventsObserved;
+  std::size_t mOverflows;
+  bool mOverflowPending;
+
+  std::mutex mStopMutex;
+  std::condition_variable mStopCondition;
+  bool mStopping;
+  std::thread mAuditThread;
+};
+
+#endif
@@ -3,17 +3,28 @@
 
 #include <filesystem>
 #include <map>
+#include <optional>
 
 namespace fs = std::filesystem;
 
-enum EventType : uint8_t {
+enum EventType : uint16_t {
   NONE = 0,
   CREATED = 1 << 0,
   CHANGED = 1 << 1,
   DELETED = 1 << 2,
   RENAMED = 1 << 3,
   OVERFLOW = 1 << 4,
-  FAILED = 1 << 5
+  FAILED = 1 << 5,
+  /// 初始扫描车道上某个子树的 CREATED 事件已全部送出，relativePath 为该子树
+  SCAN_COMPLETE = 1 << 6,
+  /// 事件风暴被聚合：relativePath 目录下的子树发生了大量变化，应整体重新扫描
+  SUBTREE_DIRTY = 1 << 7,
+  /// 追踪模式：文件被截断，appended 为截断后的全部内容
+  TRUNCATED = 1 << 8,
+  /// 追踪模式：该路径上已换成另一个文件（inode 不同），appended 从新文件开头算起
+  ROTATED = 1 << 9,
+  /// 与 CHANGED 同时出现：合并时同一路径先删除后又出现，已不是原来的文件或目录，原目录下的内容都已不在
+  REPLACED = 1 << 10
 };
 
 inline bool noop(const EventType eventType) { return eventType == NONE; }
@@ -42,18 +53,38 @@ inline bool failed(const EventType eventType) {
   return (eventType & FAILED) == FAILED;
 }
 
+inline bool scan_complete(const EventType eventType) {
+  return (eventType & SCAN_COMPLETE) == SCAN_COMPLETE;
+}
+
+inline bool subtree_dirty(const EventType eventType) {
+  return (eventType & SUBTREE_DIRTY) == SUBTREE_DIRTY;
+}
+
+inline bool truncated(const EventType eventType) {
+  return (eventType & TRUNCATED) == TRUNCATED;
+}
+
+inline bool rotated(const EventType eventType) {
+  return (eventType & ROTATED) == ROTATED;
+}
+
+inline bool replaced(const EventType eventType) {
+  return (eventType & REPLACED) == REPLACED;
+}
+
 inline EventType operator|(EventType lhs, EventType rhs) {
-  return static_cast<EventType>(static_cast<uint8_t>(lhs) |
-    static_cast<uint8_t>(rhs));
+  return static_cast<EventType>(static_cast<uint16_t>(lhs) |
+    static_cast<uint16_t>(rhs));
 }
 
 inline EventType operator&(EventType lhs, EventType rhs) {
-  return static_cast<EventType>(static_cast<uint8_t>(lhs) &
-    static_cast<uint8_t>(rhs));
+  return static_cast<EventType>(static_cast<uint16_t>(lhs) &
+    static_cast<uint16_t>(rhs));
 }
 
 inline EventType operator~(EventType lhs) {
-  return static_cast<EventType>(~static_cast<uint8_t>(lhs));
+  return static_cast<EventType>(~static_cast<uint16_t>(lhs));
 }
 
 const std::map<EventType, std::string> eventTypeToString = {
@@ -63,7 +94,12 @@ const std::map<EventType, std::string> eventTypeToString = {
   {DELETED, "删除"},
   {RENAMED, "重命名"},
   {OVERFLOW, "溢出"},
-  {FAILED, "失败"}
+  {FAILED, "失败"},
+  {SCAN_COMPLETE, "扫描完成"},
+  {SUBTREE_DIRTY, "子树变脏"},
+  {TRUNCATED, "截断"},
+  {ROTATED, "轮转"},
+  {REPLACED, "替换"}
 };
 
 inline std::string translate(EventType eventType) {
@@ -82,6 +118,21 @@ inline std::string translate(EventType eventType) {
   return result;
 }
 
+/// 追踪模式下文件新增内容的字节区间 [offset, offset + length)
+struct ByteRange {
+  uint64_t offset;
+  uint64_t length;
+};
+
+/// 文件身份 (st_dev, st_ino)，改名后保持不变；inode 为 0 表示未知
+struct FileId {
+  uint64_t device{0};
+  uint64_t inode{0};
+
+  bool isKnown() const { return inode != 0; }
+  auto operator<=>(const FileId&) const = default;
+};
+
 struct Event {
   using uptr = std::unique_ptr<Event>;
   Event(const EventType type, fs::path relativePath)
@@ -92,6 +143,14 @@ struct Event {
   EventType type;
   fs::path relativePath;
   std::chrono::high_resolution_clock::time_point timePoint;
+  /// 仅追踪模式下匹配的文件事件带有
+  std::optional<ByteRange> appended;
+  /// 启用日志时由 EventJournal 分配，从 1 开始单调递增；未写入日志的事件为 0
+  uint64_t sequence{0};
+  /// 仅开启文件身份时填写；改名对的两半相同
+  FileId id;
+  /// 改名覆盖或原地替换已有文件（同一路径换了 inode）时为被替换者的身份
+  FileId replaced;
 };
 
 #endif
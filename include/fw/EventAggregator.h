@@ -0,0 +1,52 @@
+#ifndef PFW_EVENT_AGGREGATOR_H
+#define PFW_EVENT_AGGREGATOR_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 目录级事件风暴聚合。
+/// 一个目录在 window 内的直接子项事件数超过阈值后进入风暴状态，此后它整个子树的逐文件事件
+/// 都被折叠成一个 SUBTREE_DIRTY，每个 window 最多发一次，风暴平息时再补发最后一次。
+/// 阈值随消费者回调耗时自适应：回调越慢（相对 Collector 周期），阈值越低。
+class EventAggregator {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  EventAggregator(std::size_t threshold,
+                  std::chrono::milliseconds window,
+                  std::chrono::milliseconds latency);
+
+  bool isEnabled() const;
+  void aggregate(std::vector<Event::uptr>& events);
+  /// 记录一次实时批次的回调耗时
+  void recordDelivery(Clock::duration elapsed);
+
+private:
+  struct DirectoryState {
+    std::size_t count{0};
+    Clock::time_point windowStart;
+    bool storming{false};
+    bool pendingDirty{false};
+    Clock::time_point lastDirty;
+  };
+
+  std::size_t effectiveThreshold() const;
+  /// directory 自身或祖先处于风暴中时返回 true，out 为最上层的风暴目录
+  bool topmostStorm(const fs::path& directory, fs::path& out) const;
+
+  const std::size_t mThreshold;
+  const std::chrono::milliseconds mWindow;
+  const std::chrono::milliseconds mLatency;
+  std::mutex mStateMutex;
+  std::map<fs::path, DirectoryState> mDirectories;
+  std::set<fs::path> mStorming;
+  /// 回调耗时的指数滑动平均（微秒）
+  double mDeliveryEma;
+};
+
+#endif
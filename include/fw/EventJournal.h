@@ -0,0 +1,105 @@
+#ifndef PFW_EVENT_JOURNAL_H
+#define PFW_EVENT_JOURNAL_H
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 磁盘事件日志的段文件格式。目录下每个段文件名为其第一条记录的序号（20 位十进制）+ ".seg"，
+/// 记录只追加、8 字节对齐，可直接 mmap 读取；末尾被截断或校验失败的记录视为未写入。
+/// VERSION 1 的段（没有文件身份字段）仍可读取，但不再追加，合并时改写为当前版本
+namespace journal {
+constexpr char MAGIC[4] = {'F', 'W', 'J', 'N'};
+constexpr uint32_t VERSION = 2;
+constexpr char SUFFIX[] = ".seg";
+
+struct SegmentHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t firstSequence;
+};
+
+struct Record {
+  uint32_t size;
+  uint16_t type;
+  uint16_t flags;
+  uint64_t sequence;
+  int64_t timestamp;
+  uint64_t offset;
+  uint64_t length;
+  /// Event::id 与 Event::replaced，inode 为 0 表示未知
+  uint64_t device;
+  uint64_t inode;
+  uint64_t replacedDevice;
+  uint64_t replacedInode;
+  uint32_t pathLength;
+  uint32_t checksum;
+};
+
+enum RecordFlags : uint16_t {
+  HAS_RANGE = 1 << 0
+};
+}
+
+/// 把 Collector 的输出追加到磁盘日志，每个事件分配单调递增的序号（写入 Event::sequence）。
+/// 活动段超过 segmentBytes 后封存；封存段累计到 compactAfter 个时合并为一个，
+/// 每个路径只保留最近的删除、创建（或替换）与最新一条，删除作为子树墓碑使其下更早的记录作废，序号保持不变。
+/// 目录以 flock 独占，同一目录的第二个写入者打开失败。FAILED 不写入日志
+class EventJournal {
+public:
+  using ptr = EventJournal*;
+
+  EventJournal(const fs::path& directory,
+               std::size_t segmentBytes = 64u << 20,
+               std::size_t compactAfter = 4,
+               bool syncEachBatch = true);
+
+  bool isOpen() const;
+  void append(std::vector<Event::uptr>& events);
+  uint64_t lastSequence();
+
+  ~EventJournal();
+
+private:
+  bool recover();
+  bool openSegment(uint64_t firstSequence);
+  void compact();
+
+  const fs::path mDirectory;
+  const std::size_t mSegmentBytes;
+  const std::size_t mCompactAfter;
+  const bool mSyncEachBatch;
+  std::mutex mJournalMutex;
+  int mLockFd;
+  fs::path mActivePath;
+  int mFd;
+  uint64_t mSegmentSize;
+  uint64_t mNextSequence;
+  std::vector<fs::path> mSealed;
+};
+
+/// 日志读取端，可在其他进程中使用。消费者重启后从最后确认的序号继续读取，不必重新扫描；
+/// 读到的区间若已被合并，得到的是每个路径的最新状态。日志应由常驻的监听进程（如 EventPublisher 所在的守护进程）
+/// 写入，消费者进程重启期间的事件才不会缺失
+class JournalReader {
+public:
+  explicit JournalReader(const fs::path& directory);
+
+  /// 读取序号大于 after 的记录，最多 limit 条，返回读到的最后一个序号（没有新记录时返回 after）
+  uint64_t read(uint64_t after,
+                std::vector<Event::uptr>& out,
+                std::size_t limit = std::numeric_limits<std::size_t>::max()) const;
+
+  /// 消费者确认进度，持久化在 <directory>/consumers/<consumer>
+  bool acknowledge(const std::string& consumer, uint64_t sequence) const;
+  uint64_t acknowledged(const std::string& consumer) const;
+
+private:
+  fs::path mDirectory;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PFW_EVENT_PUBLISHER_H
+#define PFW_EVENT_PUBLISHER_H
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "fw/EventRing.h"
+#include "fw/Filter.h"
+#include "fw/WatchOptions.h"
+
+class InotifyService;
+
+/// 发布者模式：每台主机只运行一个 InotifyService，把合并后的事件批次写入 POSIX 共享内存
+/// 中的环形缓冲区，其他进程用 EventRingReader 读取。生产者从不等待消费者，跟不上的消费者会收到 OVERFLOW
+class EventPublisher {
+public:
+  /// name 为共享内存名（/dev/shm 下），capacity 向上取整为 2 的幂。
+  /// 同名段仍属于存活的发布者时通过 Filter 报错，isPublishing() 为 false；已退出发布者的残留段会被替换
+  EventPublisher(const std::string& name,
+                 const fs::path& path,
+                 std::chrono::milliseconds latency,
+                 const WatchOptions& options = {},
+                 std::size_t capacity = 4u << 20);
+
+  bool isPublishing() const;
+  /// 仍存活的已注册消费者个数与其中最大的滞后字节数，顺带回收已退出进程占用的槽位
+  std::size_t consumers(uint64_t* maxLag = nullptr) const;
+
+  EventPublisher(const EventPublisher&) = delete;
+  EventPublisher& operator=(const EventPublisher&) = delete;
+  ~EventPublisher();
+
+private:
+  static void deliver(void* context, std::vector<Event::uptr>&& events);
+  void publish(const std::vector<Event::uptr>& events);
+
+  std::string mName;
+  std::size_t mMappingSize;
+  ring::Header* mHeader;
+  char* mData;
+  uint64_t mMask;
+  std::mutex mPublishMutex;
+  /// 下一条记录的写入位置，由 mPublishMutex 保护
+  uint64_t mPosition;
+  Filter::sptr mFilter;
+  InotifyService* mService;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PFW_EVENT_RING_H
+#define PFW_EVENT_RING_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/// 发布者与客户端共享的事件环形缓冲区布局（POSIX 共享内存 /dev/shm/<name>）。
+/// 单生产者多消费者，生产者从不等待消费者：reserve/commit 组成 seqlock，
+/// 消费者读完一段数据后检查 reserve 是否已超过 cursor + capacity，以此判断数据是否被覆盖（溢出）
+namespace ring {
+constexpr char MAGIC[4] = {'F', 'W', 'E', 'R'};
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t MAX_CONSUMERS = 32;
+constexpr uint64_t ALIGNMENT = 8;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<int32_t>::is_always_lock_free);
+
+/// 消费者槽位：pid 为 0 表示空闲，cursor 为该消费者已读到的位置，发布者据此统计滞后
+struct alignas(64) ConsumerSlot {
+  std::atomic<int32_t> pid;
+  std::atomic<uint64_t> cursor;
+};
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t capacity;
+  pid_t publisher;
+  /// 生产者即将写到的位置，写数据之前更新
+  alignas(64) std::atomic<uint64_t> reserve;
+  /// 生产者已完整写完的位置，每批更新一次
+  alignas(64) std::atomic<uint64_t> commit;
+  /// 发布者退出时置位
+  std::atomic<uint32_t> closed;
+  ConsumerSlot consumers[MAX_CONSUMERS];
+};
+
+enum RecordFlags : uint16_t {
+  HAS_RANGE = 1 << 0,
+  /// 批次的最后一条
+  END_OF_BATCH = 1 << 1,
+  /// 填充到缓冲区末尾，读者跳回开头
+  PADDING = 1 << 2
+};
+
+/// 每条记录 8 字节对齐，路径紧随其后（不含结尾 '\0'）
+struct Record {
+  uint32_t size;
+  uint16_t type;
+  uint16_t flags;
+  uint32_t pathLength;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t length;
+  /// Event::id 与 Event::replaced，inode 为 0 表示未知
+  uint64_t device;
+  uint64_t inode;
+  uint64_t replacedDevice;
+  uint64_t replacedInode;
+};
+
+constexpr uint64_t dataOffset() {
+  return (sizeof(Header) + 63) / 64 * 64;
+}
+
+constexpr uint64_t recordSize(const uint64_t pathLength) {
+  return (sizeof(Record) + pathLength + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+}
+
+#endif
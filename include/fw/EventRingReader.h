@@ -0,0 +1,223 @@
+#ifndef PFW_EVENT_RING_READER_H
+#define PFW_EVENT_RING_READER_H
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fw/Event.h"
+#include "fw/EventRing.h"
+
+/// 事件视图，只在 read / readZeroCopy 的回调期间有效
+struct EventView {
+  EventType type;
+  std::string_view relativePath;
+  std::optional<ByteRange> appended;
+  bool endOfBatch;
+  FileId id{};
+  FileId replaced{};
+};
+
+/// EventPublisher 的客户端，仅头文件，不依赖 fw 库和任何线程。
+/// 打开时从发布者当前位置开始读；被发布者套圈时报告一个 OVERFLOW，应用应整体重新扫描
+class EventRingReader {
+public:
+  explicit EventRingReader(const std::string& name)
+    : mHeader(nullptr), mData(nullptr), mMappingSize(0), mMask(0), mCursor(0), mSlot(nullptr) {
+    const auto shmName = name.starts_with('/') ? name : "/" + name;
+    const int fd = shm_open(shmName.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd == -1) { return; }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < ring::dataOffset()) {
+      close(fd);
+      return;
+    }
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) { return; }
+
+    auto* header = static_cast<ring::Header*>(mapping);
+    if (std::memcmp(header->magic, ring::MAGIC, sizeof(ring::MAGIC)) != 0 ||
+      header->version != ring::VERSION ||
+      ring::dataOffset() + header->capacity != static_cast<uint64_t>(status.st_size)) {
+      munmap(mapping, status.st_size);
+      return;
+    }
+    mHeader = header;
+    mData = static_cast<const char*>(mapping) + ring::dataOffset();
+    mMappingSize = static_cast<std::size_t>(status.st_size);
+    mMask = header->capacity - 1;
+    mCursor = mHeader->commit.load(std::memory_order_acquire);
+
+    /// 槽位用尽时照常读取，只是发布者看不到本消费者的进度
+    for (auto& slot : mHeader->consumers) {
+      int32_t expected = 0;
+      if (slot.pid.compare_exchange_strong(expected, getpid())) {
+        slot.cursor.store(mCursor, std::memory_order_relaxed);
+        mSlot = &slot;
+        break;
+      }
+    }
+  }
+
+  EventRingReader(const EventRingReader&) = delete;
+  EventRingReader& operator=(const EventRingReader&) = delete;
+
+  bool isOpen() const { return mHeader != nullptr; }
+
+  /// 发布者正常关闭，或进程已不存在（崩溃时来不及置 closed）
+  bool publisherClosed() const {
+    return mHeader == nullptr || mHeader->closed.load(std::memory_order_acquire) != 0 ||
+      (mHeader->publisher > 0 && kill(mHeader->publisher, 0) == -1 && errno == ESRCH);
+  }
+
+  /// 尚未读取的字节数
+  uint64_t pending() const {
+    return mHeader == nullptr ? 0 : mHeader->commit.load(std::memory_order_acquire) - mCursor;
+  }
+
+  /// 逐条以 EventView 回调已提交的全部事件，返回回调次数。
+  /// 先把记录拷出并通过 seqlock 校验再回调，视图内容总是完整的；被套圈时丢弃本次读到的内容，只回调一个 OVERFLOW
+  template <typename Handler>
+  std::size_t read(Handler&& handler) {
+    struct Copy {
+      EventType type;
+      std::string relativePath;
+      std::optional<ByteRange> appended;
+      bool endOfBatch;
+      FileId id;
+      FileId replaced;
+    };
+    std::vector<Copy> copies;
+    bool overflowed = false;
+    readCommitted([&copies](const EventView& view) {
+      copies.push_back({view.type, std::string(view.relativePath), view.appended, view.endOfBatch,
+                        view.id, view.replaced});
+    }, overflowed);
+    if (overflowed) {
+      handler(static_cast<const EventView&>(EventView{OVERFLOW, {}, std::nullopt, true}));
+      return 1;
+    }
+    for (const auto& copy : copies) {
+      handler(static_cast<const EventView&>(EventView{copy.type, copy.relativePath, copy.appended, copy.endOfBatch,
+                                                      copy.id, copy.replaced}));
+    }
+    return copies.size();
+  }
+
+  /// 零拷贝版本：视图直接指向共享内存，回调发生在 seqlock 校验之前，发布者可能正在覆盖这些数据。
+  /// 约定：回调中只能暂存结果，不得据此产生副作用；本次调用最后回调了 OVERFLOW 时，
+  /// 此前给出的全部视图（包括路径、类型）都可能是撕裂的，必须整体丢弃并重新扫描
+  template <typename Handler>
+  std::size_t readZeroCopy(Handler&& handler) {
+    bool overflowed = false;
+    auto count = readCommitted(handler, overflowed);
+    if (overflowed) {
+      const EventView view{OVERFLOW, {}, std::nullopt, true};
+      handler(view);
+      ++count;
+    }
+    return count;
+  }
+
+  /// 拷贝版本：先校验再追加到 out，被套圈时只追加一个 OVERFLOW
+  std::size_t read(std::vector<Event::uptr>& out) {
+    std::vector<Event::uptr> batch;
+    bool overflowed = false;
+    readCommitted([&batch](const EventView& view) {
+      auto event = std::make_unique<Event>(view.type, fs::path(view.relativePath));
+      event->appended = view.appended;
+      event->id = view.id;
+      event->replaced = view.replaced;
+      batch.push_back(std::move(event));
+    }, overflowed);
+    if (overflowed) {
+      batch.clear();
+      batch.push_back(std::make_unique<Event>(OVERFLOW, fs::path()));
+    }
+    const auto count = batch.size();
+    for (auto& event : batch) { out.push_back(std::move(event)); }
+    return count;
+  }
+
+  ~EventRingReader() {
+    if (mHeader == nullptr) { return; }
+    if (mSlot != nullptr) { mSlot->pid.store(0, std::memory_order_release); }
+    munmap(mHeader, mMappingSize);
+  }
+
+private:
+  template <typename Handler>
+  std::size_t readCommitted(Handler&& handler, bool& overflowed) {
+    if (mHeader == nullptr) { return 0; }
+    const uint64_t start = mCursor;
+    const uint64_t end = mHeader->commit.load(std::memory_order_acquire);
+    if (end == start) { return 0; }
+    if (end - start > mHeader->capacity) {
+      overflowed = true;
+      advance(end);
+      return 0;
+    }
+
+    std::size_t count = 0;
+    bool torn = false;
+    for (uint64_t position = start; position < end;) {
+      const uint64_t offset = position & mMask;
+      const uint64_t remaining = mHeader->capacity - offset;
+      if (remaining < sizeof(ring::Record)) {
+        position += remaining;
+        continue;
+      }
+      ring::Record record{};
+      std::memcpy(&record, mData + offset, sizeof(record));
+      if (record.size < sizeof(ring::Record) || record.size > remaining ||
+        record.pathLength > record.size - sizeof(ring::Record)) {
+        torn = true;
+        break;
+      }
+      position += record.size;
+      if (record.flags & ring::PADDING) { continue; }
+
+      EventView view{static_cast<EventType>(record.type),
+                     std::string_view(mData + offset + sizeof(ring::Record), record.pathLength),
+                     std::nullopt,
+                     (record.flags & ring::END_OF_BATCH) != 0};
+      if (record.flags & ring::HAS_RANGE) { view.appended = ByteRange{record.offset, record.length}; }
+      view.id = {record.device, record.inode};
+      view.replaced = {record.replacedDevice, record.replacedInode};
+      handler(static_cast<const EventView&>(view));
+      ++count;
+    }
+
+    /// seqlock 校验：读完之后生产者预留的位置没有越过 start + capacity，读到的数据才完整
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (torn || mHeader->reserve.load(std::memory_order_relaxed) - start > mHeader->capacity) {
+      overflowed = true;
+      advance(mHeader->commit.load(std::memory_order_acquire));
+      return count;
+    }
+    advance(end);
+    return count;
+  }
+
+  void advance(const uint64_t position) {
+    mCursor = position;
+    if (mSlot != nullptr) { mSlot->cursor.store(position, std::memory_order_release); }
+  }
+
+  ring::Header* mHeader;
+  const char* mData;
+  std::size_t mMappingSize;
+  uint64_t mMask;
+  uint64_t mCursor;
+  ring::ConsumerSlot* mSlot;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PFW_EVENT_STREAM_H
+#define PFW_EVENT_STREAM_H
+
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "fw/Filter.h"
+#include "fw/InotifyService.h"
+
+/// 拉取式事件流：以无线程模式运行 InotifyService，批次在消费者自己的线程上取出，
+/// 没有跨线程投递。接入 epoll/io_uring 等反应器时监听 fd()，可读后调用 drain() 或 dispatch()
+class EventStream {
+public:
+  using Batch = std::vector<Event::uptr>;
+
+  /// co_await stream.nextBatch() 的等待体：已有批次时不挂起，否则挂起到下一次 dispatch()
+  class BatchAwaiter {
+  public:
+    explicit BatchAwaiter(EventStream& stream) : mStream(stream) {}
+
+    bool await_ready() const;
+    void await_suspend(std::coroutine_handle<> handle) const;
+    Batch await_resume() const;
+
+  private:
+    EventStream& mStream;
+  };
+
+  EventStream(const fs::path& path, WatchOptions options = {});
+  EventStream(const EventStream&) = delete;
+  EventStream& operator=(const EventStream&) = delete;
+
+  bool isWatching() const;
+  bool isReady() const;
+  bool watch(const fs::path& path);
+  bool unwatch(const fs::path& path);
+
+  /// 可读时有待取出的事件；监听失败时为 -1
+  int fd() const;
+  /// 非阻塞：处理已就绪的内核事件并取出全部批次，没有事件时返回空
+  std::vector<Batch> drain();
+  /// 同一时刻最多一个协程等待
+  BatchAwaiter nextBatch();
+  /// 由反应器在 fd() 可读时调用：处理就绪事件，有批次且有协程在等待时在当前线程恢复它
+  void dispatch();
+
+  ~EventStream();
+
+private:
+  static void deliver(void* context, Batch&& events);
+  /// 运行一个周期并把投递的批次移入 mPending
+  void pump();
+
+  /// 在其他线程上产生的错误也会进入 mDelivered，因此需要加锁
+  std::mutex mDeliveredMutex;
+  std::vector<Batch> mDelivered;
+  std::deque<Batch> mPending;
+  std::coroutine_handle<> mWaiter;
+  std::unique_ptr<InotifyService> mService;
+};
+
+#endif
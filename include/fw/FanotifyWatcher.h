@@ -0,0 +1,53 @@
+#ifndef PFW_FANOTIFY_WATCHER_H
+#define PFW_FANOTIFY_WATCHER_H
+
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "fw/Collector.h"
+
+namespace fs = std::filesystem;
+
+/// fanotify 后端：对根目录所在文件系统做一个 FAN_MARK_FILESYSTEM 标记，
+/// 以 FAN_REPORT_DFID_NAME 接收 (父目录句柄, 名称) 形式的事件，不需要逐目录 watch 和启动时遍历。
+/// 目录句柄经 open_by_handle_at 解析为路径并缓存，根目录之外的事件被丢弃。
+/// 根目录之外的目录只放进容量为 MAX_OUTSIDE_DIRECTORIES 的缓存，按先进先出淘汰，繁忙的主机上不会无限增长。
+/// 需要 CAP_SYS_ADMIN（标记文件系统）和 CAP_DAC_READ_SEARCH（解析句柄）。
+class FanotifyWatcher {
+public:
+  using ptr = FanotifyWatcher*;
+
+  FanotifyWatcher(const fs::path& root, Collector::sptr collector);
+
+  bool isWatching() const;
+
+  ~FanotifyWatcher();
+
+private:
+  void work();
+  void handleEvents(const char* buffer, ssize_t bytesRead);
+  bool resolve(const void* fileHandle, const char* name, fs::path& out);
+  bool resolveDirectory(const void* fileHandle, fs::path& out);
+  void cacheDirectory(const fs::path& absolutePath);
+  void renameDirectory(const fs::path& oldPath, const fs::path& newPath);
+  void forgetDirectory(const fs::path& absolutePath);
+
+  static constexpr std::size_t MAX_OUTSIDE_DIRECTORIES = 4096;
+
+  const fs::path mRoot;
+  Collector::sptr mCollector;
+  int mFanotifyFd;
+  int mMountFd;
+  int mStopFd;
+  std::unordered_map<std::string, fs::path> mDirectoryCache;
+  std::unordered_map<std::string, fs::path> mOutsideCache;
+  std::deque<std::string> mOutsideOrder;
+  std::atomic<bool> mRunning;
+  std::thread mReadThread;
+};
+
+#endif
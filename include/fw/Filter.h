@@ -7,20 +7,43 @@
 
 #include "fw/Event.h"
 #include "fw/Listener.h"
+#include "fw/SubscriptionTrie.h"
 
 using CallBackSignatur = std::function<void(std::vector<Event::uptr>&&)>;
 
 class Filter : public Listener<CallBackSignatur> {
 public:
   using sptr = std::shared_ptr<Filter>;
+  /// 直接投递：绕过监听器表、订阅表、互斥锁与 std::function，供 BasicWatcher 内联整条投递路径。
+  /// Collector 取出 sink 后直接调用，不再经过 filterAndNotify；直接投递模式下 subscribe 的订阅收不到事件。
+  /// Collector 只在投递线程（Collector 线程，无线程模式下为调用 pump 的线程）上调用 sink，其他线程上的错误
+  /// 也先排入 Collector 的输入队列，因此 sink 不会被并发调用。Filter::sendError 在调用线程上直接投递，
+  /// 只能在 Collector 创建之前使用
+  using DirectSink = void (*)(void* context, std::vector<Event::uptr>&& events);
+
+  /// 只通过 subscribe 接收事件
+  Filter();
   Filter(const CallBackSignatur& callBack);
+  Filter(DirectSink sink, void* context);
   ~Filter();
 
   void sendError(const std::string& errorMsg);
   void filterAndNotify(std::vector<Event::uptr>&& events);
+  /// 非直接投递模式下为 nullptr
+  DirectSink directSink() const;
+  void* sinkContext() const;
+
+  /// 只接收 prefix（相对监听根目录，空表示整棵树）之下且类型与 mask 相交的事件
+  SubscriptionTrie::Handle subscribe(const fs::path& prefix,
+                                     const CallBackSignatur& callBack,
+                                     EventType mask = SubscriptionTrie::ALL_EVENTS);
+  void unsubscribe(SubscriptionTrie::Handle handle);
 
 private:
   CallbackHandle mCallbackHandle;
+  DirectSink mDirectSink;
+  void* mSinkContext;
+  SubscriptionTrie mSubscriptions;
 };
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef PFW_IDENTITY_TRACKER_H
+#define PFW_IDENTITY_TRACKER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 文件身份跟踪。遍历时记录每个文件和目录的 (st_dev, st_ino)（取自遍历本身，不额外 stat），投递前给事件填上 Event::id：
+/// 删除使用记录的身份（文件已不在），其余事件沿用记录的身份，只有没有记录的路径才 lstat。
+/// 改名时整棵子树的记录随之转到新路径，消费者可以按身份重新挂接缓存而不必重建；
+/// 改名覆盖或原地替换时 Event::replaced 为被替换者。实时批次须在合并之前标注，删除+新建合并成的修改才能带上 replaced
+class IdentityTracker {
+public:
+  IdentityTracker();
+
+  void configure(const fs::path& root);
+  bool isEnabled() const;
+
+  /// id 未知（符号链接、回放）时不记录，之后的事件再 lstat
+  void seed(const fs::path& relPath, const FileId& id);
+  void annotate(std::vector<Event::uptr>& events);
+
+private:
+  bool stat(const fs::path& relPath, FileId& id) const;
+  FileId known(const fs::path& relPath) const;
+  /// path 及其子孙的记录
+  void eraseSubtree(const fs::path& path);
+  void moveSubtree(const fs::path& from, const fs::path& to);
+
+  std::atomic<bool> mEnabled;
+  std::mutex mIdentityMutex;
+  fs::path mRoot;
+  std::map<fs::path, FileId> mIds;
+};
+
+#endif
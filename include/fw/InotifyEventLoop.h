@@ -7,6 +7,7 @@
 #include "fw/InotifyService.h"
 
 class InotifyService;
+class InotifyRecorder;
 namespace fs = std::filesystem;
 
 class InotifyEventLooper {
@@ -30,11 +31,25 @@ class InotifyEventLooper {
 
 public:
   using ptr = InotifyEventLooper*;
-  InotifyEventLooper(int inotifyInstance, InotifyService* inotifyService);
+  /// threaded 为 false 时不启动读取线程，inotifyInstance 须为非阻塞，由调用方在可读时调用 pump；
+  /// shard 为该实例所属的分片，原样传给 InotifyService 用于按 wd 查找树
+  InotifyEventLooper(int inotifyInstance, InotifyService* inotifyService,
+                     InotifyRecorder* recorder = nullptr, bool threaded = true,
+                     std::size_t shard = 0);
+  /// 被动模式：不启动读取线程，由调用方通过 processBuffer/onQueueDrained 喂入数据（用于回放）
+  explicit InotifyEventLooper(InotifyService* inotifyService);
 
   bool isLooping() const;
 
   void work();
+  /// 在调用线程上读空 inotify 队列，返回处理的缓冲区个数
+  std::size_t pump();
+
+  /// 处理一次 read() 得到的完整缓冲区。IN_MOVED_FROM 可能落在缓冲区末尾，
+  /// 挂起的一半跨缓冲区保留，直到配对或队列读空
+  void processBuffer(const char* buffer, ssize_t bytesRead);
+  /// 内核队列已空：把挂起的 IN_MOVED_FROM 当作删除处理
+  void onQueueDrained();
 
   ~InotifyEventLooper();
 
@@ -47,10 +62,15 @@ private:
 
   void recordRenameOldEvent(const inotify_event* event, bool isDirectoryEvent, InotifyRenameEvent& renameEvent) const;
   void recordRenameNewEvent(const inotify_event* event, bool isDirectoryEvent, InotifyRenameEvent& renameEvent) const;
+  /// 配对失败的 IN_MOVED_FROM 当作删除处理
+  void flushRenameEvent(InotifyRenameEvent& renameEvent) const;
 
   void handleEvent(const inotify_event* event, InotifyRenameEvent& renameEvent) const;
   InotifyService* mInotifyService;
+  InotifyRecorder* mRecorder;
+  InotifyRenameEvent mRenameEvent;
   const int mInotifyInstance;
+  const std::size_t mShard;
   std::atomic<bool> mRunning;
 
   std::thread mEventLoopThread;
@@ -5,10 +5,21 @@
 #include <sys/inotify.h>
 #include <filesystem>
 #include <map>
+#include <vector>
+
+#include "fw/Event.h"
 
 class InotifyTree;
 namespace fs = std::filesystem;
 
+/// 目录遍历得到的一个条目（已排除符号链接和无法 stat 的条目）
+struct DirEntry {
+  fs::path name;
+  bool isDirectory;
+  /// 遍历顺带得到的 (st_dev, st_ino)，供文件身份使用；符号链接与回放得到的条目为未知
+  FileId id{};
+};
+
 class InotifyNode {
 public:
   using ptr = InotifyNode*;
@@ -20,15 +31,20 @@ public:
               bool bSendInitEvent);
 
   void initRecursively(bool bSendInitEvent);
+  /// 为遍历得到的条目建立子节点，已存在的子节点跳过
+  void addChildren(const std::vector<DirEntry>& entries, bool bSendInitEvent);
   void addChild(const fs::path& name, bool sendInitEvents);
   void fixPaths();
   fs::path getRelativePath() const;
   fs::path getName() const;
   bool isAlive() const;
+  /// relPath 上的目录就是本节点监听的那一个：同一个 inode 再次 add_watch 得到相同的 wd；路径已不存在时无法判断，按是处理
+  bool watches(const fs::path& relPath) const;
 
   /// remove by name
   void removeChildNode(const fs::path& name);
   InotifyNode::ptr getParentNode() const;
+  InotifyNode::ptr getChildNode(const fs::path& name) const;
   InotifyNode::ptr removeAndGetChildNode(const fs::path& name);
   void insertChildNode(InotifyNode::ptr childNode);
   void setNewParentNode(const fs::path& filename, InotifyNode::ptr parentNode);
@@ -42,6 +58,9 @@ public:
 private:
   static fs::path
   createFullPath(const fs::path& root, const fs::path& relPath);
+  /// 同一个 inode 再次 add_watch 得到相同的 wd：stale 是丢失改名半边后留在旧位置的节点，
+  /// 从父节点摘下并删除，共用的 watch 留给本节点
+  void releaseStaleNode(InotifyNode::ptr stale);
 //@format:off
   int                                  mWatchDescriptor;
   bool                                 mAlive;
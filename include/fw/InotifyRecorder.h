@@ -0,0 +1,63 @@
+#ifndef PFW_INOTIFY_RECORDER_H
+#define PFW_INOTIFY_RECORDER_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "fw/InotifyNode.h"
+
+namespace fs = std::filesystem;
+
+/// 录制文件格式（本机字节序）：
+///   头部:   "FWRC" | uint16 版本 | uint32 长度 + 监听根目录
+///   记录:   uint8 类型 | uint64 相对录制开始的纳秒数 | 负载
+///     WATCH:   int32 wd | int32 errno | uint32 长度 + 相对路径
+///     LISTING: uint32 长度 + 相对路径 | uint32 条目数 | (uint8 是否目录 | uint32 长度 + 名称)*
+///     BUFFER:  uint32 长度 + 一次 read() 读到的原始 inotify_event 字节
+///     DRAIN:   无负载，表示读完该缓冲区后内核队列已空
+/// 第一条 BUFFER 之前的 WATCH/LISTING 即初始目录树快照。
+namespace recording {
+constexpr char MAGIC[4] = {'F', 'W', 'R', 'C'};
+constexpr uint16_t VERSION = 1;
+
+enum class RecordType : uint8_t {
+  WATCH = 1,
+  LISTING = 2,
+  BUFFER = 3,
+  DRAIN = 4
+};
+}
+
+class InotifyRecorder {
+public:
+  using ptr = InotifyRecorder*;
+  InotifyRecorder(const fs::path& file, const fs::path& watchRoot);
+
+  bool isOpen() const;
+
+  void recordWatch(const fs::path& relPath, int wd, int error);
+  void recordListing(const fs::path& relPath, const std::vector<DirEntry>& entries);
+  void recordBuffer(const char* buffer, std::size_t size);
+  void recordDrain();
+
+  ~InotifyRecorder();
+
+private:
+  void writeRecordHeader(recording::RecordType type);
+  void writeString(const std::string& value);
+
+  template <typename T>
+  void writeValue(const T& value) {
+    mOut.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  std::mutex mWriteMutex;
+  std::ofstream mOut;
+  std::chrono::steady_clock::time_point mStart;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef PFW_INOTIFY_REPLAYER_H
+#define PFW_INOTIFY_REPLAYER_H
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fw/Filter.h"
+#include "fw/InotifyNode.h"
+#include "fw/InotifyRecorder.h"
+
+class InotifyService;
+namespace fs = std::filesystem;
+
+/// 把 InotifyRecorder 录制的文件重新喂给 InotifyEventLooper/InotifyTree，
+/// 不依赖内核与真实文件系统，输出的事件流与录制时一致
+class InotifyReplayer {
+public:
+  using ptr = InotifyReplayer*;
+
+  enum class Pace {
+    FULL_SPEED, /// 尽快回放，用于基准测试
+    REAL_TIME   /// 按录制的时间间隔回放
+  };
+
+  InotifyReplayer(const Filter::sptr& filter,
+                  const fs::path& recordingFile,
+                  std::chrono::milliseconds latency,
+                  Pace pace = Pace::FULL_SPEED);
+
+  bool isLoaded() const;
+  fs::path getWatchRoot() const;
+
+  /// 在调用线程上回放全部缓冲区，返回回放的缓冲区个数。Collector 没有自己的线程，
+  /// 每条 DRAIN 记录处投递一个周期，结束前把两条车道中剩余的事件全部发送出去
+  std::size_t replay();
+
+  /// 由 InotifyTree 在回放模式下调用
+  int takeWatch(const fs::path& relPath, int& error);
+  bool takeListing(const fs::path& relPath, std::vector<DirEntry>& out);
+
+  ~InotifyReplayer();
+
+private:
+  struct Record {
+    recording::RecordType type;
+    std::chrono::nanoseconds timestamp;
+    fs::path relPath;
+    int wd{-1};
+    int error{0};
+    std::vector<DirEntry> entries;
+    std::string bytes;
+  };
+
+  bool load(const fs::path& recordingFile);
+  /// 把游标处直到下一个 BUFFER/DRAIN 之前的 WATCH/LISTING 记录放入待取队列
+  void stageSideEffects();
+
+  Pace mPace;
+  bool mLoaded;
+  fs::path mWatchRoot;
+  std::vector<Record> mRecords;
+  std::size_t mCursor;
+  std::map<fs::path, std::deque<std::pair<int, int>>> mWatches;
+  std::map<fs::path, std::deque<std::vector<DirEntry>>> mListings;
+  InotifyService* mService;
+};
+
+#endif
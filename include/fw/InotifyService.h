@@ -5,9 +5,15 @@
 #include "fw/Collector.h"
 #include "fw/InotifyEventLoop.h"
 #include "fw/InotifyTree.h"
+#include "fw/WatchOptions.h"
 
 class InotifyEventLooper;
 class InotifyTree;
+class InotifyRecorder;
+class InotifyReplayer;
+class PollingScanner;
+class FanotifyWatcher;
+class UringCrawler;
 
 class InotifyService {
 public:
@@ -15,33 +21,104 @@ public:
   InotifyService(const std::shared_ptr<Filter>& filter,
                  const fs::path& path,
                  std::chrono::milliseconds latency);
+  InotifyService(const std::shared_ptr<Filter>& filter,
+                 const fs::path& path,
+                 std::chrono::milliseconds latency,
+                 const WatchOptions& options);
 
   bool isWatching() const;
+  /// 初始遍历已完成；未启用渐进式启动时构造函数返回即就绪
+  bool isReady() const;
+
+  /// 运行时取消监听一个子树（绝对路径或相对主根目录的路径），释放其 watch 与节点；
+  /// 对附加的根目录调用时整棵附加树被移除。仅 inotify 后端支持
+  bool unwatch(const fs::path& path);
+  /// 运行时增加监听：主根目录之内的路径取消排除并增量建立节点；之外的路径作为附加根目录，
+  /// 共用同一个 inotify 实例，其事件路径为相对主根目录的路径（兄弟目录为 "../sibling/..."）
+  bool watch(const fs::path& path);
+
+  /// 无线程模式下的 epoll fd，inotify 队列或 Collector 车道中有待处理内容时可读；其他模式为 -1
+  int pollFd() const;
+  /// 无线程模式：读空 inotify 队列并运行一个 Collector 周期，事件在调用线程上交给 Filter
+  void pump();
+  /// 无线程模式：让 pollFd() 变为可读，供在其他线程产生结果的调用方唤醒事件循环
+  void wake() const;
 
   ~InotifyService();
 
 private:
-  void dispatchEvent(EventType action, int wd, const fs::path& name) const;
-  void dispatchEvent(EventType actionOld, int wdOld, const fs::path& nameOld,
+  /// 回放模式，仅供 InotifyReplayer 使用
+  InotifyService(const std::shared_ptr<Filter>& filter,
+                 std::chrono::milliseconds latency,
+                 InotifyReplayer* replayer);
+
+  /// shard 为产生事件的分片，0 为主实例；wd 只在所属分片的 inotify 实例内唯一
+  void dispatchEvent(std::size_t shard, EventType action, int wd, const fs::path& name) const;
+  void dispatchEvent(std::size_t shard,
+                     EventType actionOld, int wdOld, const fs::path& nameOld,
                      EventType actionNew, int wdNew, const fs::path& nameNew) const;
 
-  void emitEventCreate(int wd, const fs::path& name) const;
-  void emitEventCreateDir(int wd, const fs::path& name, bool sendInitEvents) const;
-  void emitEventModify(int wd, const fs::path& name) const;
-  void emitEventDelete(int wd, const fs::path& name) const;
-  void emitEventDeleteDir(int wd) const;
-  void emitEventDeleteDir(int wd, const fs::path& name) const;
-  void emitEventMove(int wdOld, const fs::path& nameOld, int wdNew, const fs::path& nameNew) const;
-  void emitEventMoveDir(int wdOld, const fs::path& nameOld, int wdNew, const fs::path& newName) const;
+  void emitEventCreate(std::size_t shard, int wd, const fs::path& name) const;
+  void emitEventCreateDir(std::size_t shard, int wd, const fs::path& name, bool sendInitEvents) const;
+  void emitEventModify(std::size_t shard, int wd, const fs::path& name) const;
+  void emitEventDelete(std::size_t shard, int wd, const fs::path& name) const;
+  void emitEventDeleteDir(std::size_t shard, int wd) const;
+  void emitEventDeleteDir(std::size_t shard, int wd, const fs::path& name) const;
+  void emitEventMove(std::size_t shard, int wdOld, const fs::path& nameOld,
+                     int wdNew, const fs::path& nameNew) const;
+  void emitEventMoveDir(std::size_t shard, int wdOld, const fs::path& nameOld,
+                        int wdNew, const fs::path& newName) const;
+  /// 内核事件队列溢出，之后的事件已丢弃，按约定报告一个路径为空的 OVERFLOW
+  void emitEventOverflow() const;
 
   void sendError(const std::string& errorMsg) const;
+  /// 运行时附加的树沿用服务的配置：渐进式遍历，优先路径改为相对 prefix（附加树的事件前缀）。
+  /// 启动进度回调只报告服务本身的启动，不转给附加树
+  WatchOptions subtreeOptions(const fs::path& prefix) const;
+
+  /// 分片 0 为 mTreesMutex，其余为各分片自己的锁
+  std::recursive_mutex& mutexFor(std::size_t shard) const;
+  /// 以下函数须持有 mutexFor(shard)（treeForPath 为 mTreesMutex）
+  InotifyTree* treeFor(std::size_t shard, int wd) const;
+  /// 分片模式下 wd 是主树根目录，即 name 为顶层子目录
+  bool isTopLevel(std::size_t shard, const InotifyTree* tree, int wd) const;
+  /// 包含 absolute 的树（主树或附加树），relative 为 absolute 在该树中的相对路径
+  InotifyTree* treeForPath(const fs::path& absolute, fs::path& relative) const;
+
+  /// 分片：独立的 inotify 实例、读取线程以及分到该实例的顶层子目录树（事件前缀为目录名）
+  struct Shard {
+    int instance{-1};
+    InotifyEventLooper* loop{nullptr};
+    std::vector<InotifyTree*> trees;
+    mutable std::recursive_mutex mutex;
+  };
+
+  void startShards();
+  Shard* shardOf(const fs::path& name) const;
+  /// 把顶层子目录交给所属分片（已有同名树时先替换）/ 从分片摘除
+  bool attachTopLevel(const fs::path& name, bool sendInitEvents) const;
+  void detachTopLevel(const fs::path& name) const;
+  /// 分片模式下 relative（相对主根目录）落在某个顶层子目录中时返回该目录名
+  fs::path topLevelOf(const fs::path& relative) const;
 
   InotifyEventLooper* mEventLoop;
   std::shared_ptr<Collector> mCollector;
   InotifyTree* mTree;
+  InotifyRecorder* mRecorder;
+  PollingScanner* mPoller;
+  FanotifyWatcher* mFanotify;
+  UringCrawler* mCrawler;
   int mInotifyInstance;
+  int mPollFd;
+  fs::path mRootPath;
+  std::vector<fs::path> mPriorityPaths;
+  /// 保护 mAttachedTrees；事件分发整个过程持有，移除附加树时不会与事件线程竞争
+  mutable std::recursive_mutex mTreesMutex;
+  std::vector<InotifyTree*> mAttachedTrees;
+  std::vector<Shard*> mShards;
 
   friend class InotifyEventLooper;
+  friend class InotifyReplayer;
 };
 
 #endif
@@ -3,11 +3,21 @@
 
 #include <map>
 #include <mutex>
+#include <queue>
+#include <set>
+#include <tuple>
+#include <atomic>
+#include <thread>
 #include <filesystem>
 
 #include "fw/Collector.h"
 #include "fw/InotifyNode.h"
+#include "fw/WatchOptions.h"
 
+class InotifyRecorder;
+class InotifyReplayer;
+class PollingScanner;
+class UringCrawler;
 namespace fs = std::filesystem;
 
 class InotifyTree {
@@ -15,31 +25,128 @@ public:
   using ptr = InotifyTree*;
   InotifyTree(int inotifyInstance,
               const fs::path& path,
-              Collector::sptr collector);
+              Collector::sptr collector,
+              InotifyRecorder* recorder = nullptr,
+              PollingScanner* poller = nullptr,
+              UringCrawler* crawler = nullptr,
+              const WatchOptions& options = WatchOptions{},
+              fs::path eventPrefix = fs::path(),
+              bool sendInitEvents = false,
+              bool delegateTopLevel = false);
+  /// 回放模式：watch descriptor 与目录内容均取自录制文件，不访问内核和文件系统
+  InotifyTree(InotifyReplayer* replayer, Collector::sptr collector);
 
+  /// 事件路径：节点相对路径加上 eventPrefix（附加的根目录相对主根目录的路径）
   bool getRelPath(fs::path& out, int wd);
+  fs::path getRoot() const;
+  fs::path getEventPrefix() const;
+  bool isRoot(int wd);
   bool isRootAlive() const;
+  /// 渐进式启动完成（或未启用渐进式启动）
+  bool isReady() const;
   bool nodeExists(int wd);
   void sendInitEvent(const fs::path& relPath) const;
+  void seedTail(const fs::path& relPath) const;
+  void seedIdentity(const fs::path& relPath, const FileId& id) const;
 
   void addDirNode(int wd, const fs::path& name, bool sendInitEvents);
   void removeDirNode(int wd); // by wd
   void removeDirNode(int wd, const fs::path& name); // by name
   void moveDirNode(int wdOld, const fs::path& oldName, int wdNew, const fs::path& newName);
+  /// 改名的源节点不是被移动的目录：处理旧目录的 IN_CREATE 时按路径 add_watch 落到了之后的同名目录上，
+  /// 节点与它遍历报告的内容都属于仍在原路径的那个目录。target 是改名目标的事件路径，可以在同一实例的另一棵树中
+  bool isStaleMove(int wdOld, const fs::path& oldName, const fs::path& target);
+
+  /// 运行时移除子树：释放其中所有 watch 与节点，之后该路径被排除，重新出现时也不再监听
+  bool unwatchSubtree(const fs::path& relPath);
+  /// 取消排除并重新监听子树，父目录必须已被监听
+  bool watchSubtree(const fs::path& relPath);
+  /// 不在本树建立节点的目录：被排除的子树，以及 delegateTopLevel 时根目录下的全部子目录（交给分片树）
+  bool isExcluded(const fs::path& relPath);
+  /// 仅被 unwatchSubtree 排除的路径
+  bool isUnwatched(const fs::path& relPath);
 
   ~InotifyTree();
 
 private:
+  struct CrawlTask {
+    int priority;
+    std::size_t depth;
+    uint64_t sequence;
+    int wd;
+    bool sendInitEvents;
+    uint64_t initScan;
+
+    /// priority_queue 是大顶堆：优先级小、层级浅、入队早的排在前面
+    bool operator<(const CrawlTask& other) const {
+      return std::tie(priority, depth, sequence) >
+        std::tie(other.priority, other.depth, other.sequence);
+    }
+  };
+
+  /// 一次带初始事件的子树遍历（目录新建/移入），outstanding 归零时发出 SCAN_COMPLETE
+  struct InitScan {
+    fs::path subtree;
+    std::size_t outstanding;
+  };
+
+  uint64_t beginInitScan(const fs::path& subtree);
+  void finishInitScan(uint64_t scanId);
+
+  /// 渐进式启动期间把节点的遍历交给后台线程，返回 false 时调用方应同步遍历
+  bool deferCrawl(const fs::path& relPath, int wd, bool sendInitEvents);
+  void crawl();
+  int crawlPriority(const fs::path& relPath) const;
+  void reportProgress(bool ready);
+
+  /// 排除项跟随目录改名：from 之下的排除路径改到 to 之下，调用方持有 mTreeMutex
+  void moveExclusions(const fs::path& from, const fs::path& to);
   void sendError(const std::string& error) const;
+  int addWatch(const fs::path& relPath, int mask) const;
+  /// 回放模式下 watch 不存在于内核中，不做系统调用
+  void removeWatch(int wd) const;
+  bool listDirectory(const fs::path& relPath, std::vector<DirEntry>& out) const;
+  /// 一次遍历结束，丢弃本线程未用到的预取；threadDone 为 true 时本线程不再遍历（或生命周期未知），连 ring 一起释放
+  void finishCrawl(bool threadDone) const;
+  /// watch 耗尽时把子树交给轮询扫描器
+  void pollSubtree(const fs::path& relPath, bool sendInitEvents) const;
   void addNodeReferenceByWD(int watchDescriptor, InotifyNode::ptr node);
   void removeNodeReferenceByWD(int watchDescriptor);
   InotifyNode::ptr getInotifyTreeByWatchDescriptor(int watchDescriptor);
+  InotifyNode::ptr findNode(const fs::path& relPath) const;
 
   std::mutex mapBlock;
+  /// 保护节点结构：事件线程与渐进式遍历线程都会增删节点
+  std::recursive_mutex mTreeMutex;
   Collector::sptr mCollector;
   const int mInotifyInstance;
+  fs::path mRootPath;
+  const fs::path mEventPrefix;
+  const bool mDelegateTopLevel;
+  InotifyRecorder* mRecorder;
+  InotifyReplayer* mReplayer;
+  PollingScanner* mPoller;
+  UringCrawler* mCrawler;
   InotifyNode::ptr mRoot;
   std::map<int, InotifyNode::ptr> mInotifyNodeByWatchDescriptor;
+  /// 被 unwatchSubtree 排除的相对路径，由 mTreeMutex 保护
+  std::set<fs::path> mExcluded;
+
+  mutable std::mutex mCrawlMutex;
+  std::priority_queue<CrawlTask> mCrawlQueue;
+  bool mProgressive;
+  std::atomic<bool> mStopCrawl;
+  /// 无法轮询时 ENOSPC 只报告一次
+  mutable std::atomic<bool> mSpaceExhausted;
+  uint64_t mCrawlSequence;
+  std::size_t mWatchedDirectories;
+  uint64_t mInitScanSequence;
+  /// 当前正在遍历的初始扫描，由 mTreeMutex 保护
+  uint64_t mCurrentInitScan;
+  std::map<uint64_t, InitScan> mInitScans;
+  std::vector<fs::path> mPriorityPaths;
+  StartupCallback mOnStartupProgress;
+  std::thread mCrawlThread;
   friend class InotifyNode;
 };
 
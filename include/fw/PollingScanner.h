@@ -0,0 +1,88 @@
+#ifndef PFW_POLLING_SCANNER_H
+#define PFW_POLLING_SCANNER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "fw/Collector.h"
+
+namespace fs = std::filesystem;
+
+/// 基于 mtime 的增量轮询扫描器。
+/// 用于 inotify watch 耗尽（ENOSPC）时接管子树，或作为不支持 inotify 的文件系统的纯轮询后端。
+/// 每个目录按各自的间隔调度：有变化的目录间隔回落到最小值，空闲目录逐步退避到最大值；
+/// 每个周期最多扫描 budget 个到期目录，以限制 stat 开销。
+class PollingScanner {
+public:
+  using ptr = PollingScanner*;
+
+  PollingScanner(const fs::path& root,
+                 Collector::sptr collector,
+                 std::chrono::milliseconds minInterval,
+                 std::chrono::milliseconds maxInterval,
+                 std::size_t budget);
+
+  /// 开始轮询 root 下的相对路径 relPath。sendInitEvents 为 true 时首次扫描发送 CREATED。
+  /// 本次调用启动了轮询线程（第一个被接管的子树）时返回 true
+  bool addSubtree(const fs::path& relPath, bool sendInitEvents);
+  void removeSubtree(const fs::path& relPath);
+  bool isPolling() const;
+
+  ~PollingScanner();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct EntryState {
+    bool isDirectory;
+    int64_t mtimeNs;
+    int64_t size;
+  };
+
+  struct DirState {
+    bool scanned{false};
+    bool sendInitEvents{false};
+    bool isSubtreeRoot{false};
+    int64_t mtimeNs{-1};
+    std::chrono::milliseconds interval{0};
+    std::multimap<Clock::time_point, fs::path>::iterator scheduled;
+    std::map<fs::path, EntryState> entries;
+    /// 首次扫描尚未完成、且属于某次初始扫描时为该扫描的子树根
+    std::optional<fs::path> initScan;
+  };
+
+  void work();
+  void scanDirectory(const fs::path& relPath);
+  void trackDirectory(const fs::path& relPath, bool sendInitEvents, bool isSubtreeRoot,
+                      const std::optional<fs::path>& initScan);
+  /// 子树中最后一个目录完成首次扫描时发送 SCAN_COMPLETE
+  void finishInitScan(DirState& state);
+  void forgetDirectory(const fs::path& relPath, bool sendDeleted);
+  void reschedule(DirState& state, const fs::path& relPath, bool active);
+  bool ensureRunning();
+
+  const fs::path mRoot;
+  Collector::sptr mCollector;
+  const std::chrono::milliseconds mMinInterval;
+  const std::chrono::milliseconds mMaxInterval;
+  const std::size_t mBudget;
+
+  std::mutex mStateMutex;
+  std::condition_variable mWakeUp;
+  std::map<fs::path, DirState> mDirectories;
+  std::multimap<Clock::time_point, fs::path> mSchedule;
+  /// 进行中的初始扫描：子树根 → 尚未完成首次扫描的目录数
+  std::map<fs::path, std::size_t> mInitScans;
+
+  std::atomic<bool> mRunning;
+  std::thread mScanThread;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PFW_SUBSCRIPTION_TRIE_H
+#define PFW_SUBSCRIPTION_TRIE_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 按路径前缀与事件类型掩码订阅。前缀按路径分量组织成与 InotifyNode 树同构的字典树，
+/// 每个事件只沿自己的路径走一遍，代价为 O(路径深度) 而不是 O(订阅者数)
+class SubscriptionTrie {
+public:
+  using Handle = int;
+  using Callback = std::function<void(std::vector<Event::uptr>&&)>;
+
+  static constexpr auto ALL_EVENTS = static_cast<EventType>(0xFFFF);
+
+  SubscriptionTrie();
+
+  Handle subscribe(const fs::path& prefix, EventType mask, const Callback& callback);
+  void unsubscribe(Handle handle);
+  bool empty();
+
+  /// 把 events 的副本分发给匹配的订阅者，每个订阅者每批最多回调一次。
+  /// OVERFLOW、FAILED 发给所有订阅者；删除、重命名、替换、SUBTREE_DIRTY、SCAN_COMPLETE
+  /// 还会发给订阅前缀位于该路径之下的订阅者，因为它们的子树整体受到了影响。
+  /// 回调在释放订阅锁之后执行，回调中可以 subscribe/unsubscribe；
+  /// unsubscribe 返回时，已经开始的一次分发仍可能再回调一次
+  void route(const std::vector<Event::uptr>& events);
+
+  ~SubscriptionTrie();
+
+private:
+  struct Node;
+  struct Subscription {
+    Handle handle;
+    EventType mask;
+    /// 分发时在锁内取一份引用，锁外调用
+    std::shared_ptr<const Callback> callback;
+    Node* node;
+    std::vector<Event::uptr> batch;
+  };
+  struct Node {
+    Node* parent;
+    fs::path name;
+    std::map<fs::path, Node*> children;
+    std::vector<Subscription*> subscriptions;
+  };
+
+  static fs::path normalize(const fs::path& prefix);
+  void collect(Node* node, const Event& event, std::vector<Subscription*>& touched);
+  void collectSubtree(Node* node, const Event& event, std::vector<Subscription*>& touched);
+  void prune(Node* node);
+  static void destroy(Node* node);
+
+  std::mutex mSubscriptionMutex;
+  Node* mRoot;
+  std::map<Handle, Subscription*> mSubscriptions;
+  Handle mHandleCount;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef PFW_TAIL_TRACKER_H
+#define PFW_TAIL_TRACKER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fw/Event.h"
+
+/// 日志追踪模式。对匹配 patterns 的文件按 (st_dev, st_ino) 记录上次已知的大小，
+/// 给 CREATED/CHANGED 事件填上新增的字节区间，截断与轮转通过 TRUNCATED/ROTATED 显式报告。
+/// 状态按 inode 保存，文件被改名轮转后，仍在写旧文件的进程追加的内容依旧按旧文件的偏移报告
+class TailTracker {
+public:
+  TailTracker();
+
+  /// patterns 为 fnmatch(3) 模式，与相对路径整体匹配（不带 FNM_PATHNAME，"*.log" 可匹配任意层级）
+  void configure(const fs::path& root, const std::vector<std::string>& patterns);
+  bool isEnabled() const;
+
+  /// 遍历目录时记录已有文件的当前大小，之后的 CHANGED 只报告新增部分
+  void seed(const fs::path& relPath);
+  void annotate(std::vector<Event::uptr>& events);
+
+private:
+  bool matches(const fs::path& relPath) const;
+  bool stat(const fs::path& relPath, FileId& key, uint64_t& size) const;
+  void annotateEvent(Event& event);
+
+  std::atomic<bool> mEnabled;
+  std::mutex mTailMutex;
+  fs::path mRoot;
+  std::vector<std::string> mPatterns;
+  std::map<FileId, uint64_t> mSizes;
+  /// 路径上最后一次见到的文件，用于识别轮转
+  std::map<fs::path, FileId> mKeys;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef PFW_URING_CRAWLER_H
+#define PFW_URING_CRAWLER_H
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "fw/InotifyNode.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+namespace fs = std::filesystem;
+
+/// 基于 io_uring 的目录遍历引擎，与 fs::directory_iterator + fs::status 的结果一致。
+/// - 条目类型优先取自 getdents64 的 d_type，只有符号链接和 DT_UNKNOWN 才需要 statx，
+///   这些 statx 会一次性批量提交到 io_uring；个别 statx 失败时用 fstatat 复核；
+/// - 列出一个目录时，为其子目录预先提交 IORING_OP_OPENAT，深度优先遍历走到子目录时 fd 往往已就绪。
+/// 每个调用线程（事件线程、渐进式遍历线程、各分片线程）使用各自的 ring，互不等待。
+/// 预取只在一次遍历之内有效：调用方在遍历结束时调用 finishCrawl，线程不再遍历时调用 releaseRing。
+/// 内核不支持 io_uring、被禁用或不支持 OPENAT/STATX 操作时 isAvailable() 返回 false，调用方应退回同步遍历。
+class UringCrawler {
+public:
+  using ptr = UringCrawler*;
+
+  explicit UringCrawler(unsigned queueDepth = 256);
+
+  bool isAvailable() const;
+  bool listDirectory(const fs::path& fullPath, std::vector<DirEntry>& out);
+  /// 当前线程的一次遍历结束：等待在途的预取并关闭没有用到的 fd，
+  /// 以后遍历同一路径时重新打开，不会列出改名或替换之前打开的旧目录
+  void finishCrawl();
+  /// 当前线程不再遍历（遍历线程即将退出，或调用线程的生命周期未知）：连同 ring 一起释放
+  void releaseRing();
+
+  ~UringCrawler();
+
+private:
+  struct PendingOpen {
+    std::string path;
+    bool completed{false};
+    bool consumed{false};
+    int fd{-1};
+  };
+
+  /// 单个线程独占的 ring 及其预取状态
+  class Ring {
+  public:
+    using ptr = Ring*;
+
+    explicit Ring(unsigned queueDepth);
+    bool isAvailable() const;
+    bool listDirectory(const fs::path& fullPath, std::vector<DirEntry>& out);
+    /// 等待在途的预取完成，关闭没有被取用的 fd
+    void discardPrefetches();
+    ~Ring();
+
+  private:
+    /// IORING_REGISTER_PROBE 确认 OPENAT 与 STATX 都可用
+    bool probe() const;
+    void release();
+    io_uring_sqe* nextSqe();
+    void submit(unsigned count, unsigned waitFor);
+    void reapCompletions();
+    int takeDirectoryFd(const std::string& path);
+    void prefetchOpen(const std::string& path);
+
+    int mRingFd;
+    unsigned mEntries;
+    unsigned mInflight;
+
+    void* mSqRing;
+    void* mCqRing;
+    std::size_t mSqRingSize;
+    std::size_t mCqRingSize;
+    io_uring_sqe* mSqes;
+    std::size_t mSqesSize;
+    unsigned* mSqHead;
+    unsigned* mSqTail;
+    unsigned* mSqMask;
+    unsigned* mSqArray;
+    unsigned* mCqHead;
+    unsigned* mCqTail;
+    unsigned* mCqMask;
+    io_uring_cqe* mCqes;
+
+    /// statx 批次的结果，按 user_data 下标写回
+    std::vector<int> mStatxResults;
+    std::size_t mStatxRemaining;
+    /// 预取的 openat 按提交顺序排列，mPendingBase 是队首的序号
+    std::deque<PendingOpen> mPendingOpens;
+    std::unordered_map<std::string, uint64_t> mPendingByPath;
+    uint64_t mPendingBase;
+    unsigned mOpenFds;
+  };
+
+  /// 当前线程的 ring，第一次调用时创建并保留到 releaseRing 或 crawler 销毁；创建失败返回 nullptr
+  Ring::ptr ring();
+
+  const unsigned mQueueDepth;
+  bool mAvailable;
+  std::mutex mRingsMutex;
+  std::map<std::thread::id, Ring::ptr> mRings;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PFW_WATCH_OPTIONS_H
+#define PFW_WATCH_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class WatchBackend {
+  INOTIFY, /// 每个目录一个 inotify watch，watch 耗尽的子树自动改为轮询
+  POLLING, /// 纯轮询，适用于 inotify 不会触发的文件系统（NFS、FUSE 等）
+  FANOTIFY /// 整个文件系统一个 fanotify 标记，无 watch 数量限制、启动无需遍历，需要 root
+};
+
+/// 渐进式启动的进度，ready 为 true 时整棵树已遍历完毕
+struct StartupProgress {
+  std::size_t watchedDirectories;
+  std::size_t pendingDirectories;
+  bool ready;
+};
+
+using StartupCallback = std::function<void(const StartupProgress&)>;
+
+struct AuditReport;
+using AuditCallback = std::function<void(const AuditReport&)>;
+
+/// InotifyService 的可选配置，默认值与旧的三参数构造函数行为一致
+struct WatchOptions {
+  /// 非空时把原始 inotify 字节流及初始目录快照录制到该文件，供 InotifyReplayer 回放
+  fs::path recordingFile;
+
+  /// 启动遍历及新目录遍历使用 io_uring 批量 openat/statx，内核不支持时自动退回同步遍历
+  bool ioUringCrawl = false;
+
+  /// 渐进式启动：构造函数只监听根目录即返回，其余目录由后台线程广度优先遍历，
+  /// 已监听目录的事件立即开始投递。与 recordingFile 同时设置时退回同步启动，以保证录制可回放
+  bool progressiveStartup = false;
+  /// 渐进式启动时优先遍历的相对路径（及通往它们的祖先目录）
+  std::vector<fs::path> priorityPaths;
+  /// 在遍历线程上调用，每遍历一批目录报告一次进度，完成时以 ready == true 调用一次
+  StartupCallback onStartupProgress;
+
+  /// 初始扫描车道每个周期最多投递的 CREATED 事件数
+  std::size_t initEventChunkSize = 1024;
+
+  /// 目录事件风暴聚合：一个目录在 aggregationWindow 内的事件数超过阈值后，
+  /// 其子树的逐文件事件折叠为 SUBTREE_DIRTY。0 表示关闭；实际阈值随消费者回调变慢而降低
+  std::size_t aggregationThreshold = 0;
+  std::chrono::milliseconds aggregationWindow{1000};
+
+  /// 关闭后 Collector 不再按路径合并，原样交给下游（BasicWatcher 的自定义合并策略）
+  bool coalesceEvents = true;
+
+  /// 追踪模式：相对路径匹配其中任一 fnmatch 模式的文件，CREATED/CHANGED 事件带上新增字节区间，
+  /// 截断与轮转以 TRUNCATED/ROTATED 报告。为空时关闭
+  std::vector<std::string> tailPatterns;
+
+  /// 文件身份：每个事件带上 (st_dev, st_ino)，改名时身份随文件转移，替换时报告被替换者。
+  /// 遍历时对每个条目多一次 lstat，并为整棵树保存一份路径到身份的映射
+  bool fileIdentity = false;
+
+  /// 非空时把投递的事件追加到该目录下的磁盘日志（EventJournal），消费者重启后用 JournalReader 续读
+  fs::path journalDirectory;
+  std::size_t journalSegmentBytes = 64u << 20;
+
+  /// 审计模式：大于 0 时按投递的事件重建路径视图，每隔这么久与文件系统的全新扫描对账一次，
+  /// 在审计线程上调用 onAudit 报告丢失事件的比例与类别（见 ConsistencyAuditor）。每次对账都遍历整棵树，仅用于验证
+  std::chrono::milliseconds auditInterval{0};
+  AuditCallback onAudit;
+
+  /// 大树分片：大于 1 时按顶层子目录名哈希分给这么多个 inotify 实例，各自一个读取线程并行处理；
+  /// 主实例只监听根目录本身。事件汇入同一个 Collector 合并为一个流：同一分片内保持内核给出的顺序，
+  /// 不同分片之间按各自读取线程交给 Collector 的先后排列（与 Event::timePoint 一致），
+  /// 并发发生在不同顶层子目录中的操作不保证按真实发生顺序排列。跨分片的目录移动无法配对，
+  /// 报告为删除加创建，移入的目录会报告其内容（初始扫描车道）。与 recordingFile、threadless 同时设置时不分片，
+  /// 分片中的树不做渐进式启动，而是在构造时按分片并行遍历
+  std::size_t inotifyShards = 1;
+
+  /// 无线程模式：不启动 inotify 读取线程与 Collector 线程，调用方在 InotifyService::pollFd() 可读时
+  /// 调用 pump()，事件在调用线程上投递。仅 inotify 后端支持；渐进式启动与轮询兜底仍使用各自的线程
+  bool threadless = false;
+
+  WatchBackend backend = WatchBackend::INOTIFY;
+  /// 轮询调度参数：活跃目录按最小间隔扫描，空闲目录逐步退避到最大间隔
+  std::chrono::milliseconds pollMinInterval{200};
+  std::chrono::milliseconds pollMaxInterval{5000};
+  /// 每个最小间隔内最多扫描的目录数
+  std::size_t pollBudget = 512;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef PFW_WATCH_REGISTRY_H
+#define PFW_WATCH_REGISTRY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fw/Filter.h"
+#include "fw/WatchOptions.h"
+
+class InotifyService;
+
+/// 进程级的监听注册表。目录树重叠的监听共享同一个 InotifyService（一个 inotify 实例、一棵树），
+/// 每个使用者按自己的根目录订阅其中一段，事件路径改写为相对自己的根目录。
+/// 共享的树在最后一个使用者释放时销毁。新的监听落在已有树之内时直接复用；
+/// 若新的根目录是已有树的祖先，则新建一棵更大的树，旧树的使用者迁移到新树上，旧树随即销毁
+/// （迁移瞬间可能重复收到少量事件）。新树的遍历在注册表锁之外进行，其他 acquire/release 不必等待；
+/// 根目录无效的树把错误送达其使用者后不再被复用。
+/// 只有 latency 与影响投递内容的选项（后端、合并、聚合、追踪、文件身份等）都相同的监听才共享一棵树；
+/// 带录制、日志、审计或启动进度回调的监听独占自己的树，不与其他使用者共享
+class WatchRegistry {
+public:
+  using Handle = int;
+
+  static WatchRegistry& instance();
+
+  /// 事件投递给 filter。无线程模式没有线程驱动共享树，拒绝并通过 filter 报告错误，返回 0。
+  /// 可以在事件回调中调用 release：最后一个租约释放时共享树交给后台线程销毁
+  Handle acquire(const Filter::sptr& filter,
+                 const fs::path& path,
+                 std::chrono::milliseconds latency,
+                 const WatchOptions& options = {});
+  void release(Handle handle);
+
+  /// 当前共享树的个数
+  std::size_t sharedTrees();
+
+  WatchRegistry(const WatchRegistry&) = delete;
+  WatchRegistry& operator=(const WatchRegistry&) = delete;
+
+private:
+  WatchRegistry();
+  ~WatchRegistry();
+
+  struct SharedTree {
+    fs::path root;
+    std::chrono::milliseconds latency;
+    WatchOptions options;
+    Filter::sptr backend;
+    InotifyService* service;
+    std::size_t references;
+    /// service 构造完成；之前其他使用者等待 mTreeReady
+    bool ready;
+  };
+  struct Lease {
+    SharedTree* tree;
+    SubscriptionTrie::Handle subscription;
+    Filter::sptr filter;
+    fs::path root;
+  };
+
+  /// 返回根目录为 path 本身或其祖先、且配置与 latency/options 相同的可共享树中最大的一棵
+  SharedTree* findCovering(const fs::path& path, std::chrono::milliseconds latency,
+                           const WatchOptions& options) const;
+  static SubscriptionTrie::Handle subscribe(const SharedTree* tree, const Filter::sptr& filter, const fs::path& root);
+  /// 从表中摘下这一棵树，同一根目录上的其他树不受影响
+  void eraseTree(const SharedTree* tree);
+  /// 把被更大的、配置相同的就绪树覆盖的树的租约迁移过去，返回从注册表摘下的树
+  std::vector<SharedTree*> consolidate();
+  /// 销毁共享树；在事件回调中（可能就在它的 Collector 线程上）交给后台线程
+  void dispose(const std::vector<SharedTree*>& trees);
+  void reap();
+
+  std::mutex mRegistryMutex;
+  std::condition_variable mTreeReady;
+  /// 同一根目录上可能有配置不同的多棵树
+  std::multimap<fs::path, SharedTree*> mTrees;
+  std::map<Handle, Lease> mLeases;
+  Handle mHandleCount;
+
+  std::mutex mReaperMutex;
+  std::condition_variable mReaperWake;
+  std::deque<SharedTree*> mGraveyard;
+  bool mStopping;
+  std::thread mReaper;
+};
+
+/// 通过 WatchRegistry 共享底层监听的 RAII 封装，用法与 InotifyService 相同
+class SharedWatch {
+public:
+  SharedWatch(const Filter::sptr& filter,
+              const fs::path& path,
+              std::chrono::milliseconds latency,
+              const WatchOptions& options = {});
+  ~SharedWatch();
+
+  SharedWatch(const SharedWatch&) = delete;
+  SharedWatch& operator=(const SharedWatch&) = delete;
+
+private:
+  WatchRegistry::Handle mHandle;
+};
+
+#endif
@@ -1,15 +1,92 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
 #include <thread>
 
 #include "fw/Collector.h"
 
-Collector::Collector(const Filter::sptr& filter, const std::chrono::milliseconds sleepDuration)
-  : mFilter(filter), mSleepDuration(sleepDuration), mRunning(true) {
+namespace {
+const auto PASSTHROUGH = OVERFLOW | FAILED | SCAN_COMPLETE | SUBTREE_DIRTY;
+
+/// 某条路径在本批次内的净变化：批次开始前是否存在、当前是否存在、批次开始前的那一个是否已被删除
+struct PathState {
+  std::size_t index;
+  bool existedBefore;
+  bool existsNow;
+  bool replaced;
+};
+
+EventType netType(const PathState& state) {
+  if (!state.existedBefore) { return state.existsNow ? CREATED : NONE; }
+  if (!state.existsNow) { return DELETED; }
+  return state.replaced ? CHANGED | REPLACED : CHANGED;
+}
+
+bool isRenamePair(const Event& from, const Event& to) {
+  return renamed(from.type) && deleted(from.type) && renamed(to.type) && created(to.type);
+}
+
+bool isInside(const fs::path& path, const fs::path& ancestor) {
+  return std::mismatch(ancestor.begin(), ancestor.end(), path.begin(), path.end()).first == ancestor.end();
+}
+
+/// states 中是否还有 path 之下的路径（按路径分量比较，子路径紧跟在 path 之后）
+bool hasDescendants(const std::map<fs::path, PathState>& states, const fs::path& path) {
+  const auto next = states.upper_bound(path);
+  if (next == states.end()) { return false; }
+  return isInside(next->first, path);
+}
+
+/// paths 中是否有 path 本身或其子孙
+bool touches(const std::set<fs::path>& paths, const fs::path& path) {
+  const auto itr = paths.lower_bound(path);
+  return itr != paths.end() && isInside(*itr, path);
+}
+
+/// 改名后 path 下的同名路径已是另一批文件，连同子孙一起丢弃合并状态
+void eraseSubtree(std::map<fs::path, PathState>& states, const fs::path& path) {
+  states.erase(path);
+  while (hasDescendants(states, path)) {
+    states.erase(states.upper_bound(path));
+  }
+}
+}
+
+Collector::Collector(const Filter::sptr& filter,
+                     const std::chrono::milliseconds sleepDuration,
+                     const std::size_t initChunkSize,
+                     const std::size_t aggregationThreshold,
+                     const std::chrono::milliseconds aggregationWindow,
+                     const bool coalesceEvents,
+                     const bool threaded)
+  : mFilter(filter), mDirectSink(filter->directSink()), mSinkContext(filter->sinkContext())
+    , mSleepDuration(sleepDuration), mRunning(threaded)
+    , mAggregator(aggregationThreshold, aggregationWindow, sleepDuration)
+    , mJournal(nullptr)
+    , mAuditor(nullptr)
+    , mWakeFd(-1)
+    , mInitChunkSize(std::max<std::size_t>(initChunkSize, 1))
+    , mCoalesceEvents(coalesceEvents) {
+  if (!threaded) {
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return;
+  }
   mRunner = std::thread(&Collector::work, this);
 }
 
 Collector::~Collector() {
   mRunning = false;
   if (mRunner.joinable()) { mRunner.join(); }
+  /// 服务构造失败后可能立即被销毁，还在排队的错误仍要送达；投递线程已经停止，不会与之并发
+  std::vector<Event::uptr> errors;
+  for (auto& event : inputVector) {
+    if (failed(event->type)) { errors.push_back(std::move(event)); }
+  }
+  deliver(std::move(errors));
+  delete mJournal.load();
+  delete mAuditor.load();
+  if (mWakeFd != -1) { close(mWakeFd); }
 }
 
 /*void Collector::stop() {
@@ -25,39 +102,297 @@ void Collector::work() {
 
 void Collector::sendEvents() {
   std::vector<Event::uptr> result;
+  /// 本周期只投递取走实时批次之前已经排队的扫描结果：之后排队的可能晚于仍在输入队列中的实时事件，
+  /// 先于它们送出会让旧目录内容的删除落在新目录遍历出的创建之后
+  std::chrono::high_resolution_clock::time_point cutoff;
   {
-    std::lock_guard lock(event_input_mutex);
+    std::scoped_lock lock(event_input_mutex, init_input_mutex);
     std::swap(inputVector, result);
+    cutoff = std::chrono::high_resolution_clock::now();
   }
 
-  std::map<fs::path, std::vector<Event::uptr>::reverse_iterator> values;
-  for (auto itr = result.rbegin(); itr != result.rend(); ++itr) {
-    auto [pos, inserted] = values.emplace((*itr)->relativePath, itr);
+  /// 合并会把本批次新建又改名的目录折叠成新路径上的创建，改名对要在合并之前看
+  retarget(result);
+  /// 在合并与聚合之前：删除+新建合并成的修改要带上 replaced，被折叠的事件也要更新身份记录
+  if (mIdentity.isEnabled()) { mIdentity.annotate(result); }
+  if (mCoalesceEvents) { coalesce(result); }
 
-    if (inserted) { continue; }
+  if (mAggregator.isEnabled()) { mAggregator.aggregate(result); }
+  /// 被聚合掉的事件不推进追踪状态，下一次报告的区间会覆盖这段内容
+  if (mTail.isEnabled()) { mTail.annotate(result); }
+  journal(result);
+  observe(result);
 
-    Event::uptr& event = *itr;
-    const Event::uptr& conflictedEvent = *pos->second;
-    conflictedEvent->type = conflictedEvent->type | event->type;
+  const auto started = EventAggregator::Clock::now();
+  const bool delivered = !result.empty();
+  deliver(std::move(result));
+  if (delivered && mAggregator.isEnabled()) {
+    mAggregator.recordDelivery(EventAggregator::Clock::now() - started);
+  }
+
+  /// 实时事件优先，初始扫描结果每个周期只送出一块
+  std::vector<Event::uptr> chunk;
+  {
+    std::lock_guard lock(init_input_mutex);
+    while (chunk.size() < mInitChunkSize && !initQueue.empty() && initQueue.front()->timePoint <= cutoff) {
+      chunk.push_back(std::move(initQueue.front()));
+      initQueue.pop_front();
+    }
+  }
+  if (mIdentity.isEnabled()) { mIdentity.annotate(chunk); }
+  journal(chunk);
+  observe(chunk);
+  deliver(std::move(chunk));
+}
 
-    event.reset(nullptr);
+void Collector::journal(std::vector<Event::uptr>& events) {
+  if (events.empty()) { return; }
+  if (const auto journal = mJournal.load(std::memory_order_acquire)) {
+    journal->append(events);
   }
-  std::erase_if(result, [](const Event::uptr& value) { return !value; });
-  mFilter->filterAndNotify(std::move(result));
 }
 
-void Collector::sendError(const std::string& errorMsg) const {
-  mFilter->sendError(errorMsg);
+void Collector::deliver(std::vector<Event::uptr>&& events) const {
+  if (events.empty()) { return; }
+  if (mDirectSink != nullptr) {
+    mDirectSink(mSinkContext, std::move(events));
+    return;
+  }
+  mFilter->filterAndNotify(std::move(events));
+}
+
+void Collector::observe(const std::vector<Event::uptr>& events) {
+  if (events.empty()) { return; }
+  if (const auto auditor = mAuditor.load(std::memory_order_acquire)) {
+    auditor->observe(events);
+  }
+}
+
+void Collector::retarget(const std::vector<Event::uptr>& events) {
+  std::lock_guard lock(init_input_mutex);
+  if (initQueue.empty()) { return; }
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const auto& event = *events[i];
+    if (i + 1 < events.size() && isRenamePair(event, *events[i + 1])) {
+      const auto& target = events[++i]->relativePath;
+      for (auto& queued : initQueue) {
+        if (queued->timePoint > event.timePoint || !isInside(queued->relativePath, event.relativePath)) { continue; }
+        const auto rest = queued->relativePath.lexically_relative(event.relativePath);
+        queued->relativePath = rest == "." ? target : target / rest;
+      }
+      continue;
+    }
+    if ((event.type & PASSTHROUGH) != NONE || !deleted(event.type)) { continue; }
+    std::erase_if(initQueue, [&event](const Event::uptr& queued) {
+      return queued->timePoint <= event.timePoint && !scan_complete(queued->type) &&
+        isInside(queued->relativePath, event.relativePath);
+    });
+  }
+}
+
+void Collector::coalesce(std::vector<Event::uptr>& events) {
+  std::vector<Event::uptr> output;
+  output.reserve(events.size());
+  std::map<fs::path, PathState> states;
+  /// 本批次中作为屏障保留的改名两端，其下的合并状态已被丢弃
+  std::set<fs::path> barriers;
+
+  const auto apply = [&](Event::uptr event) {
+    const auto type = event->type;
+    /// 删除覆盖整棵子树：子孙此前合并出的创建与修改随之作废，只留下它们自己的删除；之后的事件重新开始合并。
+    /// 目录被移出时内核不会逐个报告子项，留下这些事件的话，父目录在原路径上重建之后，
+    /// 它们会排在新目录之前报告给消费者
+    if (deleted(type)) {
+      while (hasDescendants(states, event->relativePath)) {
+        const auto child = states.upper_bound(event->relativePath);
+        if (netType(child->second) != DELETED) { output[child->second.index].reset(); }
+        states.erase(child);
+      }
+    }
+    auto itr = states.find(event->relativePath);
+    if (itr == states.end()) {
+      const bool existedBefore = !created(type);
+      const bool existsNow = !deleted(type);
+      const PathState state{output.size(), existedBefore, existsNow, existedBefore && !existsNow};
+      event->type = netType(state);
+      states.emplace(event->relativePath, state);
+      output.push_back(std::move(event));
+      return;
+    }
+
+    auto& state = itr->second;
+    const auto before = netType(state);
+    if (deleted(type)) {
+      state.existsNow = false;
+      state.replaced = state.existedBefore;
+    }
+    if (created(type)) { state.existsNow = true; }
+    const auto after = netType(state);
+    if (after == before && output[state.index] != nullptr) { return; }
+
+    /// 含义改变后移到当前位置，保证父目录的创建在子项之前、子项的删除在父目录之前
+    output[state.index].reset();
+    state.index = output.size();
+    /// 净效果为空时留一个空位占住下标，同一路径后续的事件仍能找到它
+    if (after == NONE) { event.reset(); } else { event->type = after; }
+    output.push_back(std::move(event));
+  };
+
+  /// 屏障之后重新开始合并，但改名端点此时是否存在是已知的：移入的一端存在，移出的一端不存在。
+  /// 从空位开始，之后的事件总会另起一条，不会挪动屏障本身。祖先的合并结果也钉在屏障之前，
+  /// 否则祖先在本批次内先创建后删除时两者相抵，屏障报告的子项就落在了不存在的目录下
+  const auto restart = [&](const Event& half) {
+    eraseSubtree(states, half.relativePath);
+    for (auto ancestor = half.relativePath.parent_path(); !ancestor.empty(); ancestor = ancestor.parent_path()) {
+      states.erase(ancestor);
+    }
+    barriers.insert(half.relativePath);
+    const bool exists = created(half.type);
+    states.emplace(half.relativePath, PathState{output.size(), exists, exists, false});
+    output.emplace_back();
+  };
+
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    auto& event = events[i];
+    if (event->type & PASSTHROUGH) {
+      output.push_back(std::move(event));
+      continue;
+    }
+    if (!renamed(event->type)) {
+      apply(std::move(event));
+      continue;
+    }
+
+    auto& from = event;
+    const bool paired = i + 1 < events.size() && isRenamePair(*from, *events[i + 1]);
+    if (!paired) {
+      /// 不成对的一半当作屏障原样保留
+      const auto& half = *from;
+      output.push_back(std::move(from));
+      restart(half);
+      continue;
+    }
+    auto& to = events[++i];
+
+    /// 本批次内新建又被改名的文件，直接视为在新路径上创建；
+    /// 有改名屏障落在它下面时（移入过子目录）已无法确认它是空的，不能折叠。
+    /// 改名会覆盖目标，目标在本批次中没有出现过时不知道它原先是否存在，也不能折叠
+    const auto source = states.find(from->relativePath);
+    const auto target = states.find(to->relativePath);
+    if (source != states.end() && !source->second.existedBefore && source->second.existsNow &&
+      target != states.end() &&
+      !hasDescendants(states, from->relativePath) && !touches(barriers, from->relativePath)) {
+      output[source->second.index].reset();
+      states.erase(source);
+      /// 覆盖现有的目标相当于先删除它
+      if (target->second.existsNow) {
+        target->second.existsNow = false;
+        target->second.replaced = target->second.existedBefore;
+      }
+      to->type = CREATED;
+      apply(std::move(to));
+      continue;
+    }
+
+    /// 其余情况重命名对作为屏障：两端之前的合并结果留在原位，之后的事件重新开始合并
+    const auto& oldHalf = *from;
+    const auto& newHalf = *to;
+    output.push_back(std::move(from));
+    output.push_back(std::move(to));
+    restart(oldHalf);
+    restart(newHalf);
+  }
+
+  std::erase_if(output, [](const Event::uptr& value) { return !value; });
+  events = std::move(output);
+}
+
+void Collector::flush() {
+  while (true) {
+    sendEvents();
+    std::scoped_lock lock(event_input_mutex, init_input_mutex);
+    if (inputVector.empty() && initQueue.empty()) { return; }
+  }
+}
+
+void Collector::sendError(const std::string& errorMsg) {
+  collect(FAILED, errorMsg);
+}
+
+int Collector::wakeFd() const { return mWakeFd; }
+
+void Collector::wake() const {
+  if (mWakeFd == -1) { return; }
+  constexpr uint64_t one = 1;
+  [[maybe_unused]] const auto ignored = write(mWakeFd, &one, sizeof(one));
+}
+
+void Collector::rearm() {
+  if (mWakeFd == -1) { return; }
+  uint64_t count = 0;
+  [[maybe_unused]] const auto ignored = read(mWakeFd, &count, sizeof(count));
+  std::scoped_lock lock(event_input_mutex, init_input_mutex);
+  if (!inputVector.empty() || !initQueue.empty()) { wake(); }
 }
 
 void Collector::insert(std::vector<Event::uptr>&& events) {
   std::lock_guard lock(event_input_mutex);
+  if (inputVector.empty() && !events.empty()) { wake(); }
+  /// 在锁内重新打时间戳，各分片线程汇入的事件按收入顺序排列，timePoint 与之一致
+  const auto now = std::chrono::high_resolution_clock::now();
   for (auto& event : events) {
+    event->timePoint = now;
     inputVector.push_back(std::move(event));
   }
 }
 
 void Collector::collect(EventType type, const fs::path& relativePath) {
   std::lock_guard lock(event_input_mutex);
+  if (inputVector.empty()) { wake(); }
   inputVector.emplace_back(std::make_unique<Event>(type, relativePath));
 }
+
+void Collector::collectInit(const fs::path& relativePath) {
+  std::lock_guard lock(init_input_mutex);
+  if (initQueue.empty()) { wake(); }
+  initQueue.emplace_back(std::make_unique<Event>(CREATED, relativePath));
+}
+
+void Collector::enableTailing(const fs::path& root, const std::vector<std::string>& patterns) {
+  mTail.configure(root, patterns);
+}
+
+bool Collector::enableAudit(const ConsistencyAuditor::ptr auditor) {
+  /// Collector 线程可能正在使用已设置的 auditor，不能替换
+  ConsistencyAuditor::ptr expected = nullptr;
+  if (mAuditor.compare_exchange_strong(expected, auditor, std::memory_order_acq_rel)) { return true; }
+  delete auditor;
+  sendError("一致性审计已开启，不能重复设置");
+  return false;
+}
+
+bool Collector::enableJournal(const EventJournal::ptr journal) {
+  EventJournal::ptr expected = nullptr;
+  if (mJournal.compare_exchange_strong(expected, journal, std::memory_order_acq_rel)) { return true; }
+  delete journal;
+  sendError("事件日志已开启，不能重复设置");
+  return false;
+}
+
+void Collector::enableIdentity(const fs::path& root) {
+  mIdentity.configure(root);
+}
+
+void Collector::seedIdentity(const fs::path& relativePath, const FileId& id) {
+  mIdentity.seed(relativePath, id);
+}
+
+void Collector::seedTail(const fs::path& relativePath) {
+  mTail.seed(relativePath);
+}
+
+void Collector::completeInitScan(const fs::path& subtree) {
+  std::lock_guard lock(init_input_mutex);
+  if (initQueue.empty()) { wake(); }
+  initQueue.emplace_back(std::make_unique<Event>(SCAN_COMPLETE, subtree));
+}
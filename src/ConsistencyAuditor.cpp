@@ -0,0 +1,261 @@
+#include "fw/ConsistencyAuditor.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+bool isInside(const fs::path& path, const fs::path& ancestor) {
+  auto pathItr = path.begin();
+  for (const auto& part : ancestor) {
+    if (pathItr == path.end() || *pathItr != part) { return false; }
+    ++pathItr;
+  }
+  return true;
+}
+
+/// 根目录之外的路径（改名移入移出的另一半）以 ".." 开头
+bool isOutside(const fs::path& path) {
+  return !path.empty() && *path.begin() == "..";
+}
+
+bool isRenamePair(const Event& from, const Event& to) {
+  return renamed(from.type) && deleted(from.type) && renamed(to.type) && created(to.type);
+}
+
+/// 按路径分量排序，子孙紧跟在 path 之后
+template <typename Container>
+void eraseSubtree(Container& container, const fs::path& path) {
+  auto itr = container.lower_bound(path);
+  while (itr != container.end() && isInside(*itr, path)) {
+    itr = container.erase(itr);
+  }
+}
+
+template <typename Value>
+void eraseSubtree(std::map<fs::path, Value>& container, const fs::path& path) {
+  auto itr = container.lower_bound(path);
+  while (itr != container.end() && isInside(itr->first, path)) {
+    itr = container.erase(itr);
+  }
+}
+}
+
+ConsistencyAuditor::ConsistencyAuditor(const fs::path& root,
+                                       const std::chrono::milliseconds interval,
+                                       Callback callback)
+  : mRoot(root)
+    , mInterval(interval)
+    , mCallback(std::move(callback))
+    , mEventsObserved(0)
+    , mOverflows(0)
+    , mOverflowPending(false)
+    , mStopping(false) {
+  mView = scan();
+  if (mInterval.count() > 0) {
+    mAuditThread = std::thread(&ConsistencyAuditor::run, this);
+  }
+}
+
+std::set<fs::path> ConsistencyAuditor::scan() const {
+  /// 逐个目录遍历：recursive_directory_iterator 遇到中途消失的目录会放弃整个遍历
+  std::set<fs::path> result;
+  std::vector<fs::path> directories{fs::path()};
+  while (!directories.empty()) {
+    const auto directory = std::move(directories.back());
+    directories.pop_back();
+    std::error_code ec;
+    for (auto itr = fs::directory_iterator(mRoot / directory, ec);
+         !ec && itr != fs::directory_iterator(); itr.increment(ec)) {
+      const auto path = directory / itr->path().filename();
+      result.insert(path);
+      std::error_code statusEc;
+      if (!itr->is_symlink(statusEc) && itr->is_directory(statusEc)) { directories.push_back(path); }
+    }
+  }
+  return result;
+}
+
+void ConsistencyAuditor::observe(const std::vector<Event::uptr>& events) {
+  std::lock_guard lock(mAuditMutex);
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const auto& event = *events[i];
+    mWatermark = std::max(mWatermark, event.timePoint);
+    if (i + 1 < events.size() && isRenamePair(event, *events[i + 1]) &&
+      !isOutside(event.relativePath) && !isOutside(events[i + 1]->relativePath)) {
+      const auto& target = *events[++i];
+      mWatermark = std::max(mWatermark, target.timePoint);
+      /// 改名对：整棵子树转到新路径。有一半在根目录之外时按两个独立事件处理，由 apply 滤掉外面那一半
+      std::vector<fs::path> moved;
+      for (auto itr = mView.lower_bound(event.relativePath);
+           itr != mView.end() && isInside(*itr, event.relativePath); ++itr) {
+        moved.push_back(target.relativePath / itr->lexically_relative(event.relativePath));
+      }
+      eraseSubtree(mView, event.relativePath);
+      eraseSubtree(mView, target.relativePath);
+      for (const auto& path : moved) {
+        mView.insert(path.filename() == "." ? path.parent_path() : path);
+      }
+      mView.insert(target.relativePath);
+      for (const auto* side : {&event, &target}) {
+        mTouched.insert(side->relativePath);
+        eraseSubtree(mSuspects, side->relativePath);
+      }
+      mEventsObserved += 2;
+      continue;
+    }
+    apply(event);
+    ++mEventsObserved;
+  }
+}
+
+void ConsistencyAuditor::apply(const Event& event) {
+  const auto& path = event.relativePath;
+  if (isOutside(path)) { return; }
+
+  if (buffer_overflow(event.type)) {
+    ++mOverflows;
+    mOverflowPending = true;
+    return;
+  }
+  if ((event.type & (FAILED | SCAN_COMPLETE)) != NONE || path.empty()) { return; }
+
+  mTouched.insert(path);
+  mLastEvent[path] = event.type;
+  eraseSubtree(mSuspects, path);
+  if (subtree_dirty(event.type)) {
+    mDirtySubtrees.insert(path);
+  } else if (deleted(event.type)) {
+    eraseSubtree(mView, path);
+  } else {
+    /// 替换：原目录下的内容都已不在，新目录的内容由之后的事件报告
+    if (replaced(event.type)) { eraseSubtree(mView, path); }
+    mView.insert(path);
+  }
+}
+
+bool ConsistencyAuditor::touched(const fs::path& path) const {
+  if (mTouched.empty()) { return false; }
+  for (auto ancestor = path;; ancestor = ancestor.parent_path()) {
+    if (mTouched.contains(ancestor)) { return true; }
+    if (ancestor.empty()) { return false; }
+  }
+}
+
+AuditCategory ConsistencyAuditor::classify(const fs::path& path, const bool onDisk) const {
+  for (auto ancestor = path; !ancestor.empty(); ancestor = ancestor.parent_path()) {
+    const auto itr = mLastEvent.find(ancestor);
+    if (itr == mLastEvent.end()) { continue; }
+    if (renamed(itr->second)) { return AuditCategory::LOST_RENAME_HALF; }
+    break;
+  }
+  if (!onDisk) { return AuditCategory::MISSED_DELETE; }
+  const auto parent = path.parent_path();
+  return parent.empty() || mView.contains(parent) ? AuditCategory::MISSED_CREATE : AuditCategory::MISSED_SUBTREE;
+}
+
+AuditReport ConsistencyAuditor::audit() {
+  {
+    std::lock_guard lock(mAuditMutex);
+    mTouched.clear();
+  }
+  /// 扫描不持锁，期间到达的事件记入 mTouched，这些路径本轮不参与比较
+  const auto scanned = Clock::now();
+  const auto disk = scan();
+
+  std::lock_guard lock(mAuditMutex);
+  AuditReport report;
+  report.eventsObserved = std::exchange(mEventsObserved, 0);
+  report.overflows = std::exchange(mOverflows, 0);
+
+  const auto resync = [&](const fs::path& subtree, const bool count) {
+    std::set<fs::path> expected;
+    for (auto itr = disk.lower_bound(subtree); itr != disk.end() && isInside(*itr, subtree); ++itr) {
+      expected.insert(*itr);
+    }
+    std::size_t differences = 0;
+    for (auto itr = mView.lower_bound(subtree); itr != mView.end() && isInside(*itr, subtree); ++itr) {
+      if (!expected.contains(*itr)) { ++differences; }
+    }
+    for (const auto& path : expected) {
+      if (!mView.contains(path)) { ++differences; }
+    }
+    eraseSubtree(mView, subtree);
+    mView.insert(expected.begin(), expected.end());
+    if (count && differences > 0) {
+      report.categories[AuditCategory::OVERFLOW_RESYNC] += differences;
+    }
+  };
+
+  if (std::exchange(mOverflowPending, false)) {
+    /// 溢出后按约定整树重新扫描，此时的差异都算在溢出头上。溢出已经通知了使用者，差异中还混有在途事件，不计入 divergent
+    resync(fs::path(), true);
+    mSuspects.clear();
+  }
+  for (const auto& subtree : mDirtySubtrees) {
+    if (!subtree.empty() && *subtree.begin() == "..") { continue; }
+    resync(subtree, false);
+  }
+  mDirtySubtrees.clear();
+
+  std::vector<std::pair<fs::path, bool>> differences;
+  for (const auto& path : disk) {
+    if (!mView.contains(path) && !touched(path)) { differences.emplace_back(path, true); }
+  }
+  for (const auto& path : mView) {
+    if (!disk.contains(path) && !touched(path)) { differences.emplace_back(path, false); }
+  }
+
+  /// 投递进度越过首次发现的时刻只说明有一个读取线程追上了那次扫描，其他分片的队列里可能还有更早的事件；
+  /// 一轮没有投递也不能单独说明管线空闲，读取线程可能被长时间的遍历阻塞。两者同时成立才确认丢失
+  const bool quiet = report.eventsObserved == 0;
+  std::map<fs::path, Suspect> suspects;
+  for (const auto& [path, onDisk] : differences) {
+    const auto previous = mSuspects.find(path);
+    if (previous == mSuspects.end()) {
+      suspects.emplace(path, Suspect{classify(path, onDisk), scanned});
+      continue;
+    }
+    if (!quiet || mWatermark < previous->second.since) {
+      suspects.insert(*previous);
+      continue;
+    }
+    /// 连续两次不一致、期间没有事件触及且管线已静止：确认丢失，并按磁盘修正视图，避免重复计数
+    ++report.categories[previous->second.category];
+    ++report.divergent;
+    if (report.samples.size() < MAX_SAMPLES) { report.samples.push_back(path); }
+    if (onDisk) {
+      mView.insert(path);
+    } else {
+      mView.erase(path);
+    }
+  }
+  mSuspects = std::move(suspects);
+  mLastEvent.clear();
+
+  report.diskPaths = disk.size();
+  report.viewPaths = mView.size();
+  report.pending = mSuspects.size();
+  report.divergenceRate = disk.empty()
+                            ? 0
+                            : static_cast<double>(report.divergent) / static_cast<double>(disk.size());
+  return report;
+}
+
+void ConsistencyAuditor::run() {
+  std::unique_lock lock(mStopMutex);
+  while (!mStopCondition.wait_for(lock, mInterval, [this] { return mStopping; })) {
+    lock.unlock();
+    const auto report = audit();
+    if (mCallback) { mCallback(report); }
+    lock.lock();
+  }
+}
+
+ConsistencyAuditor::~ConsistencyAuditor() {
+  {
+    std::lock_guard lock(mStopMutex);
+    mStopping = true;
+  }
+  mStopCondition.notify_all();
+  if (mAuditThread.joinable()) { mAuditThread.join(); }
+}
@@ -0,0 +1,132 @@
+#include "fw/EventAggregator.h"
+
+namespace {
+constexpr double EMA_WEIGHT = 0.2;
+
+bool aggregatable(const EventType type) {
+  return (type & (OVERFLOW | FAILED | SCAN_COMPLETE | SUBTREE_DIRTY)) == NONE;
+}
+
+bool isRenamePair(const Event& from, const Event& to) {
+  return renamed(from.type) && deleted(from.type) && renamed(to.type) && created(to.type);
+}
+}
+
+EventAggregator::EventAggregator(const std::size_t threshold,
+                                 const std::chrono::milliseconds window,
+                                 const std::chrono::milliseconds latency)
+  : mThreshold(threshold)
+    , mWindow(window)
+    , mLatency(std::max(latency, std::chrono::milliseconds(1)))
+    , mDeliveryEma(0) {}
+
+bool EventAggregator::isEnabled() const { return mThreshold > 0; }
+
+void EventAggregator::recordDelivery(const Clock::duration elapsed) {
+  std::lock_guard lock(mStateMutex);
+  const auto micros = static_cast<double>(
+    std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+  mDeliveryEma = mDeliveryEma * (1 - EMA_WEIGHT) + micros * EMA_WEIGHT;
+}
+
+std::size_t EventAggregator::effectiveThreshold() const {
+  const auto latency = static_cast<double>(
+    std::chrono::duration_cast<std::chrono::microseconds>(mLatency).count());
+  const double lag = std::max(1.0, mDeliveryEma / latency);
+  return std::max<std::size_t>(1, static_cast<std::size_t>(static_cast<double>(mThreshold) / lag));
+}
+
+bool EventAggregator::topmostStorm(const fs::path& directory, fs::path& out) const {
+  if (mStorming.empty()) { return false; }
+  bool found = false;
+  for (auto path = directory;; path = path.parent_path()) {
+    if (mStorming.contains(path)) {
+      out = path;
+      found = true;
+    }
+    if (path.empty() || path == path.parent_path()) { return found; }
+  }
+}
+
+void EventAggregator::aggregate(std::vector<Event::uptr>& events) {
+  std::lock_guard lock(mStateMutex);
+  const auto now = Clock::now();
+  const auto threshold = effectiveThreshold();
+  std::vector<Event::uptr> dirty;
+
+  /// 窗口到期：风暴仍在持续则开启新窗口，否则结束风暴并补发最后一次 SUBTREE_DIRTY
+  for (auto itr = mDirectories.begin(); itr != mDirectories.end();) {
+    auto& [directory, state] = *itr;
+    if (now - state.windowStart < mWindow) {
+      ++itr;
+      continue;
+    }
+    if (state.storming && state.count > threshold) {
+      state.count = 0;
+      state.windowStart = now;
+      ++itr;
+      continue;
+    }
+    if (state.storming && state.pendingDirty) {
+      dirty.emplace_back(std::make_unique<Event>(SUBTREE_DIRTY, directory));
+    }
+    mStorming.erase(directory);
+    itr = mDirectories.erase(itr);
+  }
+
+  /// 先统计整批事件再决定哪些目录进入风暴，同一批次里越过阈值之前的事件也一并折叠
+  for (const auto& event : events) {
+    if (!aggregatable(event->type)) { continue; }
+    const auto directory = event->relativePath.parent_path();
+    auto [itr, inserted] = mDirectories.try_emplace(directory);
+    auto& state = itr->second;
+    if (inserted) { state.windowStart = now; }
+    if (++state.count > threshold && !state.storming) {
+      state.storming = true;
+      mStorming.insert(directory);
+    }
+  }
+
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    auto& event = events[i];
+    if (!aggregatable(event->type)) { continue; }
+    /// 改名对是一个整体：两端都落在风暴中才一起折叠，否则原样保留，下游不会看到孤立的半边
+    if (i + 1 < events.size() && isRenamePair(*event, *events[i + 1])) {
+      auto& to = events[++i];
+      fs::path fromStorm, toStorm;
+      if (!topmostStorm(event->relativePath.parent_path(), fromStorm) ||
+        !topmostStorm(to->relativePath.parent_path(), toStorm)) {
+        continue;
+      }
+      mDirectories[fromStorm].pendingDirty = true;
+      mDirectories[toStorm].pendingDirty = true;
+      event.reset();
+      to.reset();
+      continue;
+    }
+    fs::path storm;
+    if (!topmostStorm(event->relativePath.parent_path(), storm)) { continue; }
+    mDirectories[storm].pendingDirty = true;
+    event.reset();
+  }
+  std::erase_if(events, [](const Event::uptr& value) { return !value; });
+
+  for (const auto& directory : mStorming) {
+    auto& state = mDirectories[directory];
+    if (!state.pendingDirty || (state.lastDirty != Clock::time_point() && now - state.lastDirty < mWindow)) {
+      continue;
+    }
+    state.pendingDirty = false;
+    /// 祖先目录也在风暴中时只报告最上层
+    if (fs::path storm; !directory.empty() && topmostStorm(directory.parent_path(), storm)) {
+      mDirectories[storm].pendingDirty = true;
+      continue;
+    }
+    state.lastDirty = now;
+    dirty.emplace_back(std::make_unique<Event>(SUBTREE_DIRTY, directory));
+  }
+
+  for (auto& event : dirty) {
+    events.push_back(std::move(event));
+  }
+}
@@ -0,0 +1,495 @@
+#include "fw/EventJournal.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <string_view>
+
+namespace {
+constexpr uint64_t ALIGNMENT = 8;
+const auto SUBTREE_TYPES = SUBTREE_DIRTY | OVERFLOW | SCAN_COMPLETE;
+
+/// VERSION 1 的记录格式
+struct LegacyRecord {
+  uint32_t size;
+  uint16_t type;
+  uint16_t flags;
+  uint64_t sequence;
+  int64_t timestamp;
+  uint64_t offset;
+  uint64_t length;
+  uint32_t pathLength;
+  uint32_t checksum;
+};
+constexpr uint32_t LEGACY_VERSION = 1;
+
+template <typename Record>
+uint32_t checksum(const Record& record, const char* path) {
+  /// FNV-1a，覆盖 checksum 字段之前的所有字段与路径
+  uint32_t hash = 2166136261u;
+  const auto mix = [&hash](const char* data, const std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+  };
+  mix(reinterpret_cast<const char*>(&record), offsetof(Record, checksum));
+  mix(path, record.pathLength);
+  return hash;
+}
+
+fs::path segmentPath(const fs::path& directory, const uint64_t firstSequence) {
+  auto name = std::to_string(firstSequence);
+  name.insert(0, 20 - std::min<std::size_t>(name.size(), 20), '0');
+  return directory / (name + journal::SUFFIX);
+}
+
+/// 目录下的段文件，按第一个序号升序
+std::vector<std::pair<uint64_t, fs::path>> listSegments(const fs::path& directory) {
+  std::vector<std::pair<uint64_t, fs::path>> segments;
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(directory, ec)) {
+    if (entry.path().extension() != journal::SUFFIX) { continue; }
+    const auto stem = entry.path().stem().string();
+    uint64_t first = 0;
+    const auto [end, error] = std::from_chars(stem.data(), stem.data() + stem.size(), first);
+    if (error != std::errc() || end != stem.data() + stem.size()) { continue; }
+    segments.emplace_back(first, entry.path());
+  }
+  std::ranges::sort(segments);
+  return segments;
+}
+
+/// 只读映射整个文件，空文件返回成功且 data 为 nullptr
+bool mapFile(const fs::path& path, const char*& data, std::size_t& size) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) { return false; }
+  struct stat status{};
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return false;
+  }
+  size = static_cast<std::size_t>(status.st_size);
+  data = nullptr;
+  if (size > 0) {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    data = static_cast<const char*>(mapping);
+  }
+  close(fd);
+  return true;
+}
+
+void unmapFile(const char* data, const std::size_t size) {
+  if (data != nullptr) { munmap(const_cast<char*>(data), size); }
+}
+
+/// 段头有效时返回段的版本，否则返回 0
+uint32_t segmentVersion(const char* data, const uint64_t size) {
+  journal::SegmentHeader header{};
+  if (data == nullptr || size < sizeof(header)) { return 0; }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, journal::MAGIC, sizeof(journal::MAGIC)) != 0) { return 0; }
+  return header.version == journal::VERSION || header.version == LEGACY_VERSION ? header.version : 0;
+}
+
+template <typename Record, typename OnRecord>
+uint64_t scanRecords(const char* data, const uint64_t size, OnRecord&& onRecord) {
+  uint64_t position = sizeof(journal::SegmentHeader);
+  while (position + sizeof(Record) <= size) {
+    Record record{};
+    std::memcpy(&record, data + position, sizeof(record));
+    const char* path = data + position + sizeof(record);
+    if (record.size < sizeof(record) || position + record.size > size ||
+      record.pathLength > record.size - sizeof(record) || record.checksum != checksum(record, path)) {
+      break;
+    }
+    onRecord(record, path);
+    position += record.size;
+  }
+  return position;
+}
+
+/// 依次回调段内有效记录（旧版本记录转换为当前格式，身份为未知），返回有效数据的结尾偏移；段头无效时返回 0
+template <typename OnRecord>
+uint64_t scanSegment(const char* data, const uint64_t size, OnRecord&& onRecord) {
+  const auto version = segmentVersion(data, size);
+  if (version == journal::VERSION) { return scanRecords<journal::Record>(data, size, onRecord); }
+  if (version != LEGACY_VERSION) { return 0; }
+  return scanRecords<LegacyRecord>(data, size, [&onRecord](const LegacyRecord& legacy, const char* path) {
+    journal::Record record{};
+    record.type = legacy.type;
+    record.flags = legacy.flags;
+    record.sequence = legacy.sequence;
+    record.timestamp = legacy.timestamp;
+    record.offset = legacy.offset;
+    record.length = legacy.length;
+    record.pathLength = legacy.pathLength;
+    onRecord(static_cast<const journal::Record&>(record), path);
+  });
+}
+
+/// 按当前格式追加一条记录，size 与 checksum 在这里计算
+void serialize(std::string& buffer, journal::Record record, const std::string_view path) {
+  record.size = static_cast<uint32_t>((sizeof(record) + path.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+  record.pathLength = static_cast<uint32_t>(path.size());
+  record.checksum = checksum(record, path.data());
+
+  const auto start = buffer.size();
+  buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+  buffer.append(path);
+  buffer.resize(start + record.size, '\0');
+}
+
+void serialize(std::string& buffer, const Event& event) {
+  journal::Record record{};
+  record.type = static_cast<uint16_t>(event.type);
+  record.sequence = event.sequence;
+  record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    event.timePoint.time_since_epoch()).count();
+  if (event.appended) {
+    record.flags |= journal::HAS_RANGE;
+    record.offset = event.appended->offset;
+    record.length = event.appended->length;
+  }
+  record.device = event.id.device;
+  record.inode = event.id.inode;
+  record.replacedDevice = event.replaced.device;
+  record.replacedInode = event.replaced.inode;
+  serialize(buffer, record, event.relativePath.native());
+}
+
+bool writeAll(const int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    const auto written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+}
+
+EventJournal::EventJournal(const fs::path& directory,
+                           const std::size_t segmentBytes,
+                           const std::size_t compactAfter,
+                           const bool syncEachBatch)
+  : mDirectory(directory)
+    , mSegmentBytes(std::max<std::size_t>(segmentBytes, 4096))
+    , mCompactAfter(std::max<std::size_t>(compactAfter, 2))
+    , mSyncEachBatch(syncEachBatch)
+    , mLockFd(-1)
+    , mFd(-1)
+    , mSegmentSize(0)
+    , mNextSequence(1) {
+  std::error_code ec;
+  fs::create_directories(mDirectory, ec);
+  if (ec) { return; }
+  /// 同一目录只允许一个写入者，否则两个进程会在同一个活动段里交错追加
+  mLockFd = open(mDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (mLockFd == -1 || flock(mLockFd, LOCK_EX | LOCK_NB) != 0) { return; }
+  if (!recover()) {
+    if (mFd != -1) { close(mFd); }
+    mFd = -1;
+  }
+}
+
+bool EventJournal::isOpen() const { return mFd != -1; }
+
+bool EventJournal::recover() {
+  auto segments = listSegments(mDirectory);
+  if (segments.empty()) { return openSegment(mNextSequence); }
+
+  const auto [first, active] = segments.back();
+  segments.pop_back();
+  for (const auto& path : segments | std::views::values) { mSealed.push_back(path); }
+
+  /// 序号从所有段中最大的一个继续；活动段末尾被截断的半条记录丢弃
+  mNextSequence = first;
+  for (const auto& [segmentFirst, path] : segments) {
+    const char* data = nullptr;
+    std::size_t size = 0;
+    if (!mapFile(path, data, size)) { continue; }
+    scanSegment(data, size, [this](const journal::Record& record, const char*) {
+      mNextSequence = std::max(mNextSequence, record.sequence + 1);
+    });
+    unmapFile(data, size);
+  }
+
+  const char* data = nullptr;
+  std::size_t size = 0;
+  if (!mapFile(active, data, size)) { return false; }
+  const auto version = segmentVersion(data, size);
+  const auto validEnd = scanSegment(data, size, [this](const journal::Record& record, const char*) {
+    mNextSequence = std::max(mNextSequence, record.sequence + 1);
+  });
+  unmapFile(data, size);
+  if (validEnd == 0) { return openSegment(std::max(first, mNextSequence)); }
+  if (version != journal::VERSION) {
+    /// 旧版本的段不再追加：有记录时封存，在新段中继续
+    if (mNextSequence == first) { return openSegment(first); }
+    mSealed.push_back(active);
+    return openSegment(mNextSequence);
+  }
+
+  mActivePath = active;
+  mFd = open(active.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (mFd == -1 || ftruncate(mFd, static_cast<off_t>(validEnd)) != 0) { return false; }
+  mSegmentSize = validEnd;
+  return true;
+}
+
+bool EventJournal::openSegment(const uint64_t firstSequence) {
+  mActivePath = segmentPath(mDirectory, firstSequence);
+  mFd = open(mActivePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (mFd == -1) { return false; }
+
+  journal::SegmentHeader header{};
+  std::memcpy(header.magic, journal::MAGIC, sizeof(journal::MAGIC));
+  header.version = journal::VERSION;
+  header.firstSequence = firstSequence;
+  if (!writeAll(mFd, reinterpret_cast<const char*>(&header), sizeof(header))) { return false; }
+  mSegmentSize = sizeof(header);
+  return true;
+}
+
+void EventJournal::append(std::vector<Event::uptr>& events) {
+  std::lock_guard lock(mJournalMutex);
+  if (mFd == -1) { return; }
+
+  std::string buffer;
+  const auto firstSequence = mNextSequence;
+  for (const auto& event : events) {
+    if (failed(event->type)) { continue; }
+    event->sequence = mNextSequence++;
+    serialize(buffer, *event);
+  }
+  if (buffer.empty()) { return; }
+
+  if (!writeAll(mFd, buffer.data(), buffer.size())) {
+    /// 写入失败时回退序号，半条记录会在下次恢复时被校验丢弃
+    for (const auto& event : events) { event->sequence = 0; }
+    mNextSequence = firstSequence;
+    ftruncate(mFd, static_cast<off_t>(mSegmentSize));
+    return;
+  }
+  if (mSyncEachBatch) { fdatasync(mFd); }
+  mSegmentSize += buffer.size();
+
+  if (mSegmentSize < mSegmentBytes) { return; }
+  fdatasync(mFd);
+  close(mFd);
+  mFd = -1;
+  mSealed.push_back(mActivePath);
+  if (mSealed.size() >= mCompactAfter) { compact(); }
+  openSegment(mNextSequence);
+}
+
+void EventJournal::compact() {
+  /// 每个路径最多保留三条：最近一次删除、其后最近一次创建或替换（CREATED、改名移入、CHANGED|REPLACED）、
+  /// 以及再之后最新的一条普通事件；子树级事件（SUBTREE_DIRTY 等）与文件事件分开保留。
+  /// 删除不会被之后同一路径上的创建覆盖，只会被更晚的删除取代；它同时是子树墓碑，此前该路径之下的记录全部作废，
+  /// 否则目录删除后重建会让旧的子项复活。改名对的两半按相邻序号配对，只有一半被更晚的删除或创建取代时
+  /// 另一半才去掉 RENAMED，不留下孤立的改名记录。结果按当前版本重新写出，旧版本的段借此升级
+  using Entry = std::pair<journal::Record, std::string>;
+  struct PathRecords {
+    std::optional<Entry> tombstone;
+    std::optional<Entry> origin;
+    std::optional<Entry> update;
+  };
+  std::map<std::string, PathRecords> latest;
+  /// 序号 -> 配对另一半的键与序号
+  std::map<uint64_t, std::pair<std::string, uint64_t>> partners;
+  const auto forget = [&latest, &partners](const std::optional<Entry>& entry) {
+    if (!entry) { return; }
+    const auto partner = partners.find(entry->first.sequence);
+    if (partner == partners.end()) { return; }
+    const auto& [partnerKey, partnerSequence] = partner->second;
+    if (const auto survivor = latest.find(partnerKey); survivor != latest.end()) {
+      for (auto* slot : {&survivor->second.tombstone, &survivor->second.origin, &survivor->second.update}) {
+        if (*slot && (*slot)->first.sequence == partnerSequence) {
+          auto& record = (*slot)->first;
+          record.type = static_cast<uint16_t>(static_cast<EventType>(record.type) & ~RENAMED);
+        }
+      }
+    }
+    partners.erase(partnerSequence);
+    partners.erase(partner);
+  };
+  const auto forgetAll = [&forget](const PathRecords& records) {
+    forget(records.tombstone);
+    forget(records.origin);
+    forget(records.update);
+  };
+
+  std::string renameFrom;
+  uint64_t renameFromSequence = 0;
+  for (const auto& path : mSealed) {
+    const char* data = nullptr;
+    std::size_t size = 0;
+    if (!mapFile(path, data, size)) { continue; }
+    scanSegment(data, size, [&](const journal::Record& record, const char* name) {
+      const auto type = static_cast<EventType>(record.type);
+      std::string relative(name, record.pathLength);
+      auto key = relative;
+      key.push_back((type & SUBTREE_TYPES) != NONE ? '\1' : '\0');
+
+      if (deleted(type)) {
+        const auto prefix = relative.empty() ? relative : relative + '/';
+        for (auto it = latest.lower_bound(prefix); it != latest.end() && it->first.starts_with(prefix);) {
+          forgetAll(it->second);
+          it = latest.erase(it);
+        }
+        auto& kept = latest[key];
+        forgetAll(kept);
+        kept = {};
+        kept.tombstone = {record, std::move(relative)};
+      } else if (created(type) || replaced(type)) {
+        auto& kept = latest[key];
+        forget(kept.origin);
+        forget(kept.update);
+        kept.origin = {record, std::move(relative)};
+        kept.update.reset();
+      } else {
+        auto& kept = latest[key];
+        forget(kept.update);
+        kept.update = {record, std::move(relative)};
+      }
+
+      if (renamed(type) && created(type) && !renameFrom.empty() && renameFromSequence + 1 == record.sequence) {
+        partners[renameFromSequence] = {key, record.sequence};
+        partners[record.sequence] = {renameFrom, renameFromSequence};
+      }
+      renameFrom = renamed(type) && deleted(type) ? key : std::string();
+      renameFromSequence = record.sequence;
+    });
+    unmapFile(data, size);
+  }
+
+  std::vector<Entry> records;
+  records.reserve(latest.size());
+  for (auto& [tombstone, origin, update] : latest | std::views::values) {
+    for (auto* slot : {&tombstone, &origin, &update}) {
+      if (*slot) { records.push_back(std::move(**slot)); }
+    }
+  }
+  std::ranges::sort(records, {}, [](const Entry& entry) { return entry.first.sequence; });
+  std::string buffer;
+  for (const auto& [record, relative] : records) { serialize(buffer, record, relative); }
+
+  /// 合并结果沿用第一个封存段的文件名，写临时文件后原子替换
+  const auto& target = mSealed.front();
+  auto temporary = target;
+  temporary += ".tmp";
+  const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) { return; }
+
+  const char* data = nullptr;
+  std::size_t size = 0;
+  journal::SegmentHeader header{};
+  if (mapFile(target, data, size) && size >= sizeof(header)) { std::memcpy(&header, data, sizeof(header)); }
+  unmapFile(data, size);
+  std::memcpy(header.magic, journal::MAGIC, sizeof(journal::MAGIC));
+  header.version = journal::VERSION;
+
+  bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+  ok = ok && writeAll(fd, buffer.data(), buffer.size());
+  ok = ok && fdatasync(fd) == 0;
+  close(fd);
+  if (!ok || rename(temporary.c_str(), target.c_str()) != 0) {
+    unlink(temporary.c_str());
+    return;
+  }
+  for (std::size_t i = 1; i < mSealed.size(); ++i) { unlink(mSealed[i].c_str()); }
+  mSealed.resize(1);
+}
+
+uint64_t EventJournal::lastSequence() {
+  std::lock_guard lock(mJournalMutex);
+  return mNextSequence - 1;
+}
+
+EventJournal::~EventJournal() {
+  if (mFd != -1) {
+    fdatasync(mFd);
+    close(mFd);
+  }
+  if (mLockFd != -1) { close(mLockFd); }
+}
+
+JournalReader::JournalReader(const fs::path& directory) : mDirectory(directory) {}
+
+uint64_t JournalReader::read(const uint64_t after,
+                             std::vector<Event::uptr>& out,
+                             const std::size_t limit) const {
+  const auto initialSize = out.size();
+  /// 读取过程中遇到被合并删除的段时重新列目录重读
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    out.resize(initialSize);
+    uint64_t last = after;
+    bool vanished = false;
+    const auto segments = listSegments(mDirectory);
+    for (std::size_t i = 0; i < segments.size() && out.size() - initialSize < limit; ++i) {
+      if (i + 1 < segments.size() && segments[i + 1].first <= after + 1) { continue; }
+      const char* data = nullptr;
+      std::size_t size = 0;
+      if (!mapFile(segments[i].second, data, size)) {
+        vanished = true;
+        break;
+      }
+      scanSegment(data, size, [&](const journal::Record& record, const char* path) {
+        if (record.sequence <= last || out.size() - initialSize >= limit) { return; }
+        auto event = std::make_unique<Event>(static_cast<EventType>(record.type),
+                                             fs::path(std::string(path, record.pathLength)));
+        event->sequence = record.sequence;
+        event->timePoint = std::chrono::high_resolution_clock::time_point(
+          std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+            std::chrono::nanoseconds(record.timestamp)));
+        if (record.flags & journal::HAS_RANGE) { event->appended = ByteRange{record.offset, record.length}; }
+        event->id = {record.device, record.inode};
+        event->replaced = {record.replacedDevice, record.replacedInode};
+        out.push_back(std::move(event));
+        last = record.sequence;
+      });
+      unmapFile(data, size);
+    }
+    if (!vanished) { return last; }
+  }
+  out.resize(initialSize);
+  return after;
+}
+
+bool JournalReader::acknowledge(const std::string& consumer, const uint64_t sequence) const {
+  const auto directory = mDirectory / "consumers";
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+  auto temporary = directory / (consumer + ".tmp");
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!(out << sequence)) { return false; }
+  }
+  fs::rename(temporary, directory / consumer, ec);
+  return !ec;
+}
+
+uint64_t JournalReader::acknowledged(const std::string& consumer) const {
+  std::ifstream in(mDirectory / "consumers" / consumer);
+  uint64_t sequence = 0;
+  in >> sequence;
+  return sequence;
+}
@@ -0,0 +1,172 @@
+#include "fw/EventPublisher.h"
+#include "fw/InotifyService.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <bit>
+
+namespace {
+/// 已存在的段属于仍在运行、尚未关闭的发布者时返回其 pid，否则返回 0（残留段可以回收）
+pid_t livePublisher(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) { return 0; }
+  struct stat status{};
+  if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < ring::dataOffset()) {
+    close(fd);
+    return 0;
+  }
+  void* mapping = mmap(nullptr, ring::dataOffset(), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) { return 0; }
+  const auto* header = static_cast<const ring::Header*>(mapping);
+  pid_t owner = 0;
+  if (std::memcmp(header->magic, ring::MAGIC, sizeof(ring::MAGIC)) == 0 &&
+    header->closed.load(std::memory_order_acquire) == 0 && header->publisher > 0 &&
+    (kill(header->publisher, 0) == 0 || errno != ESRCH)) {
+    owner = header->publisher;
+  }
+  munmap(mapping, ring::dataOffset());
+  return owner;
+}
+}
+
+EventPublisher::EventPublisher(const std::string& name,
+                               const fs::path& path,
+                               const std::chrono::milliseconds latency,
+                               const WatchOptions& options,
+                               const std::size_t capacity)
+  : mName(name.starts_with('/') ? name : "/" + name)
+    , mMappingSize(0)
+    , mHeader(nullptr)
+    , mData(nullptr)
+    , mMask(0)
+    , mPosition(0)
+    , mFilter(std::make_shared<Filter>(&EventPublisher::deliver, this))
+    , mService(nullptr) {
+  const uint64_t ringCapacity = std::bit_ceil(std::max<uint64_t>(capacity, 4096));
+  mMappingSize = ring::dataOffset() + ringCapacity;
+
+  /// 同名段仍属于活着的发布者时直接失败；发布者已退出的残留段才回收，旧段上的读者保留原映射
+  int fd = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd == -1 && errno == EEXIST) {
+    if (const pid_t owner = livePublisher(mName); owner != 0) {
+      mFilter->sendError("共享内存已被发布者 " + std::to_string(owner) + " 占用： " + mName);
+      return;
+    }
+    shm_unlink(mName.c_str());
+    fd = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  }
+  if (fd == -1) {
+    mFilter->sendError("无法创建共享内存： " + mName);
+    return;
+  }
+  if (ftruncate(fd, static_cast<off_t>(mMappingSize)) != 0) {
+    close(fd);
+    shm_unlink(mName.c_str());
+    mFilter->sendError("无法设置共享内存大小： " + mName);
+    return;
+  }
+  void* mapping = mmap(nullptr, mMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(mName.c_str());
+    mFilter->sendError("无法映射共享内存： " + mName);
+    return;
+  }
+
+  /// ftruncate 得到的内存全为 0，原子变量与消费者槽位已处于初始状态；magic 最后写入
+  mHeader = static_cast<ring::Header*>(mapping);
+  mData = static_cast<char*>(mapping) + ring::dataOffset();
+  mMask = ringCapacity - 1;
+  mHeader->version = ring::VERSION;
+  mHeader->capacity = ringCapacity;
+  mHeader->publisher = getpid();
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(mHeader->magic, ring::MAGIC, sizeof(ring::MAGIC));
+
+  mService = new InotifyService(mFilter, path, latency, options);
+}
+
+bool EventPublisher::isPublishing() const {
+  return mHeader != nullptr && mService != nullptr && mService->isWatching();
+}
+
+void EventPublisher::deliver(void* context, std::vector<Event::uptr>&& events) {
+  static_cast<EventPublisher*>(context)->publish(events);
+}
+
+void EventPublisher::publish(const std::vector<Event::uptr>& events) {
+  if (mHeader == nullptr || events.empty()) { return; }
+  /// 错误可能来自遍历线程，与 Collector 线程串行化；消费者一侧无锁
+  std::lock_guard lock(mPublishMutex);
+  const uint64_t capacity = mHeader->capacity;
+
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const auto& event = *events[i];
+    const auto& path = event.relativePath.native();
+    const uint64_t size = ring::recordSize(path.size());
+    if (size > capacity) { continue; }
+
+    uint64_t offset = mPosition & mMask;
+    const uint64_t remaining = capacity - offset;
+    const uint64_t padding = remaining < size ? remaining : 0;
+    mHeader->reserve.store(mPosition + padding + size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (padding != 0) {
+      if (padding >= sizeof(ring::Record)) {
+        const ring::Record filler{static_cast<uint32_t>(padding), NONE, ring::PADDING, 0, 0, 0, 0, 0, 0, 0, 0};
+        std::memcpy(mData + offset, &filler, sizeof(filler));
+      }
+      mPosition += padding;
+      offset = 0;
+    }
+
+    ring::Record record{static_cast<uint32_t>(size), static_cast<uint16_t>(event.type), 0,
+                        static_cast<uint32_t>(path.size()), 0, 0, 0,
+                        event.id.device, event.id.inode, event.replaced.device, event.replaced.inode};
+    if (event.appended) {
+      record.flags |= ring::HAS_RANGE;
+      record.offset = event.appended->offset;
+      record.length = event.appended->length;
+    }
+    if (i + 1 == events.size()) { record.flags |= ring::END_OF_BATCH; }
+    std::memcpy(mData + offset, &record, sizeof(record));
+    std::memcpy(mData + offset + sizeof(record), path.data(), path.size());
+    mPosition += size;
+  }
+
+  mHeader->commit.store(mPosition, std::memory_order_release);
+}
+
+std::size_t EventPublisher::consumers(uint64_t* maxLag) const {
+  if (maxLag != nullptr) { *maxLag = 0; }
+  if (mHeader == nullptr) { return 0; }
+  const uint64_t commit = mHeader->commit.load(std::memory_order_acquire);
+  std::size_t alive = 0;
+  for (auto& slot : mHeader->consumers) {
+    int32_t pid = slot.pid.load(std::memory_order_acquire);
+    if (pid == 0) { continue; }
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+      slot.pid.compare_exchange_strong(pid, 0);
+      continue;
+    }
+    ++alive;
+    if (maxLag != nullptr) {
+      *maxLag = std::max(*maxLag, commit - slot.cursor.load(std::memory_order_acquire));
+    }
+  }
+  return alive;
+}
+
+EventPublisher::~EventPublisher() {
+  /// 先停掉监听，之后不会再有 publish 调用
+  delete mService;
+  if (mHeader == nullptr) { return; }
+  mHeader->closed.store(1, std::memory_order_release);
+  munmap(mHeader, mMappingSize);
+  shm_unlink(mName.c_str());
+}
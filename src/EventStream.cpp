@@ -0,0 +1,78 @@
+#include "fw/EventStream.h"
+
+#include <utility>
+
+bool EventStream::BatchAwaiter::await_ready() const {
+  if (mStream.mPending.empty()) { mStream.pump(); }
+  return !mStream.mPending.empty();
+}
+
+void EventStream::BatchAwaiter::await_suspend(const std::coroutine_handle<> handle) const {
+  mStream.mWaiter = handle;
+}
+
+EventStream::Batch EventStream::BatchAwaiter::await_resume() const {
+  if (mStream.mPending.empty()) { return {}; }
+  auto batch = std::move(mStream.mPending.front());
+  mStream.mPending.pop_front();
+  return batch;
+}
+
+EventStream::EventStream(const fs::path& path, WatchOptions options) {
+  options.threadless = true;
+  options.backend = WatchBackend::INOTIFY;
+  mService = std::make_unique<InotifyService>(std::make_shared<Filter>(&EventStream::deliver, this),
+                                              path, std::chrono::milliseconds(0), options);
+  /// 构造期间报告的错误在 fd() 可读之前就已送达
+  std::lock_guard lock(mDeliveredMutex);
+  if (!mDelivered.empty()) { mService->wake(); }
+}
+
+bool EventStream::isWatching() const { return mService->isWatching(); }
+
+bool EventStream::isReady() const { return mService->isReady(); }
+
+bool EventStream::watch(const fs::path& path) { return mService->watch(path); }
+
+bool EventStream::unwatch(const fs::path& path) { return mService->unwatch(path); }
+
+int EventStream::fd() const { return mService->pollFd(); }
+
+void EventStream::deliver(void* context, Batch&& events) {
+  auto* stream = static_cast<EventStream*>(context);
+  std::lock_guard lock(stream->mDeliveredMutex);
+  stream->mDelivered.push_back(std::move(events));
+  if (stream->mService != nullptr) { stream->mService->wake(); }
+}
+
+void EventStream::pump() {
+  mService->pump();
+  std::lock_guard lock(mDeliveredMutex);
+  for (auto& batch : mDelivered) {
+    mPending.push_back(std::move(batch));
+  }
+  mDelivered.clear();
+}
+
+std::vector<EventStream::Batch> EventStream::drain() {
+  pump();
+  std::vector<Batch> batches;
+  batches.reserve(mPending.size());
+  for (auto& batch : mPending) {
+    batches.push_back(std::move(batch));
+  }
+  mPending.clear();
+  return batches;
+}
+
+EventStream::BatchAwaiter EventStream::nextBatch() { return BatchAwaiter(*this); }
+
+void EventStream::dispatch() {
+  pump();
+  if (mPending.empty() || !mWaiter) { return; }
+  std::exchange(mWaiter, nullptr).resume();
+}
+
+EventStream::~EventStream() {
+  mService.reset();
+}
@@ -0,0 +1,248 @@
+#include "fw/FanotifyWatcher.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <unistd.h>
+#include <cstring>
+#include <ranges>
+
+namespace {
+constexpr uint64_t DIRENT_EVENTS = FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_ATTRIB |
+  FAN_DELETE_SELF | FAN_MOVE_SELF | FAN_ONDIR;
+
+std::string handleKey(const file_handle* handle) {
+  return {reinterpret_cast<const char*>(handle), sizeof(file_handle) + handle->handle_bytes};
+}
+
+/// 绝对路径转换为相对监听根目录的路径，不在根目录下时返回 false
+bool toRelative(const fs::path& absolutePath, const fs::path& root, fs::path& out) {
+  auto relative = absolutePath.lexically_relative(root);
+  if (relative.empty() || *relative.begin() == "..") { return false; }
+  out = relative == "." ? fs::path() : relative;
+  return true;
+}
+}
+
+FanotifyWatcher::FanotifyWatcher(const fs::path& root, Collector::sptr collector)
+  : mRoot(fs::weakly_canonical(root))
+    , mCollector(std::move(collector))
+    , mFanotifyFd(-1), mMountFd(-1), mStopFd(-1)
+    , mRunning(false) {
+  mFanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_REPORT_DFID_NAME, O_RDONLY);
+  if (mFanotifyFd == -1) {
+    mCollector->sendError("fanotify_init 失败: " + std::string(strerror(errno)));
+    return;
+  }
+
+  if (fanotify_mark(mFanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                    DIRENT_EVENTS | FAN_RENAME, AT_FDCWD, mRoot.c_str()) == -1) {
+    /// 内核不支持 FAN_RENAME (< 5.17) 时退化为不配对的 FAN_MOVED_FROM/FAN_MOVED_TO
+    if (fanotify_mark(mFanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      DIRENT_EVENTS | FAN_MOVED_FROM | FAN_MOVED_TO, AT_FDCWD, mRoot.c_str()) == -1) {
+      mCollector->sendError("fanotify_mark 失败: " + std::string(strerror(errno)));
+      return;
+    }
+  }
+
+  mMountFd = open(mRoot.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  mStopFd = eventfd(0, EFD_CLOEXEC);
+  if (mMountFd == -1 || mStopFd == -1) {
+    mCollector->sendError("无法打开监听根目录: " + std::string(strerror(errno)));
+    return;
+  }
+
+  mRunning = true;
+  mReadThread = std::thread(&FanotifyWatcher::work, this);
+}
+
+bool FanotifyWatcher::isWatching() const { return mRunning; }
+
+void FanotifyWatcher::work() {
+  alignas(fanotify_event_metadata) char buffer[65536];
+  pollfd fds[2] = {{mFanotifyFd, POLLIN, 0}, {mStopFd, POLLIN, 0}};
+  while (mRunning) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) { continue; }
+      mCollector->sendError(strerror(errno));
+      break;
+    }
+    if (fds[1].revents & POLLIN) { break; }
+
+    const auto bytesRead = read(mFanotifyFd, buffer, sizeof(buffer));
+    if (bytesRead == -1) {
+      if (errno == EINTR || errno == EAGAIN) { continue; }
+      mCollector->sendError(strerror(errno));
+      break;
+    }
+    handleEvents(buffer, bytesRead);
+  }
+  mRunning = false;
+}
+
+void FanotifyWatcher::handleEvents(const char* buffer, ssize_t bytesRead) {
+  auto* metadata = reinterpret_cast<const fanotify_event_metadata*>(buffer);
+  for (; FAN_EVENT_OK(metadata, bytesRead); metadata = FAN_EVENT_NEXT(metadata, bytesRead)) {
+    if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+      mCollector->sendError("fanotify 元数据版本不匹配");
+      mRunning = false;
+      return;
+    }
+    if (metadata->fd >= 0) { close(metadata->fd); }
+    if (metadata->mask & FAN_Q_OVERFLOW) {
+      mCollector->collect(OVERFLOW, fs::path());
+      continue;
+    }
+
+    /// 依次解析附带的信息记录：普通事件只有一条 DFID_NAME，FAN_RENAME 带新旧两条
+    fs::path path, oldPath, newPath;
+    bool hasPath = false, hasOld = false, hasNew = false;
+    const char* info = reinterpret_cast<const char*>(metadata) + metadata->metadata_len;
+    const char* end = reinterpret_cast<const char*>(metadata) + metadata->event_len;
+    while (info + sizeof(fanotify_event_info_header) <= end) {
+      const auto* header = reinterpret_cast<const fanotify_event_info_header*>(info);
+      if (header->len == 0) { break; }
+      const auto* fid = reinterpret_cast<const fanotify_event_info_fid*>(info);
+      const auto* handle = reinterpret_cast<const file_handle*>(fid->handle);
+      const char* name = reinterpret_cast<const char*>(handle->f_handle) + handle->handle_bytes;
+      switch (header->info_type) {
+      case FAN_EVENT_INFO_TYPE_DFID_NAME:
+        hasPath = resolve(handle, name, path);
+        break;
+      case FAN_EVENT_INFO_TYPE_OLD_DFID_NAME:
+        hasOld = resolve(handle, name, oldPath);
+        break;
+      case FAN_EVENT_INFO_TYPE_NEW_DFID_NAME:
+        hasNew = resolve(handle, name, newPath);
+        break;
+      default:
+        break;
+      }
+      info += header->len;
+    }
+
+    const auto mask = metadata->mask;
+    const bool isDirectory = mask & FAN_ONDIR;
+    fs::path relative;
+
+    if (mask & FAN_RENAME) {
+      if (isDirectory && hasOld && hasNew) { renameDirectory(oldPath, newPath); }
+      fs::path oldRelative, newRelative;
+      const bool oldInside = hasOld && toRelative(oldPath, mRoot, oldRelative);
+      const bool newInside = hasNew && toRelative(newPath, mRoot, newRelative);
+      if (oldInside && newInside) {
+        std::vector<Event::uptr> pair;
+        pair.emplace_back(std::make_unique<Event>(DELETED | RENAMED, oldRelative));
+        pair.emplace_back(std::make_unique<Event>(CREATED | RENAMED, newRelative));
+        mCollector->insert(std::move(pair));
+      } else if (oldInside) {
+        mCollector->collect(DELETED, oldRelative);
+      } else if (newInside) {
+        mCollector->collect(CREATED, newRelative);
+      }
+    }
+
+    if (!hasPath || !toRelative(path, mRoot, relative)) { continue; }
+
+    if (mask & (FAN_DELETE_SELF | FAN_MOVE_SELF) && relative.empty()) {
+      mCollector->sendError("意外终止.");
+      mRunning = false;
+      return;
+    }
+    if (isDirectory && mask & (FAN_DELETE | FAN_MOVED_FROM)) { forgetDirectory(path); }
+    if (isDirectory && mask & (FAN_CREATE | FAN_MOVED_TO)) { cacheDirectory(path); }
+
+    if (mask & (FAN_CREATE | FAN_MOVED_TO)) { mCollector->collect(CREATED, relative); }
+    if (mask & (FAN_MODIFY | FAN_ATTRIB)) { mCollector->collect(CHANGED, relative); }
+    if (mask & (FAN_DELETE | FAN_MOVED_FROM)) { mCollector->collect(DELETED, relative); }
+  }
+}
+
+bool FanotifyWatcher::resolve(const void* fileHandle, const char* name, fs::path& out) {
+  fs::path directory;
+  if (!resolveDirectory(fileHandle, directory)) { return false; }
+  /// 目录自身的事件名称为 "."
+  out = std::strcmp(name, ".") == 0 || *name == '\0' ? directory : directory / name;
+  return true;
+}
+
+bool FanotifyWatcher::resolveDirectory(const void* fileHandle, fs::path& out) {
+  const auto* handle = static_cast<const file_handle*>(fileHandle);
+  auto key = handleKey(handle);
+  for (const auto* cache : {&mDirectoryCache, &mOutsideCache}) {
+    if (const auto itr = cache->find(key); itr != cache->end()) {
+      out = itr->second;
+      return true;
+    }
+  }
+
+  const int fd = open_by_handle_at(mMountFd, const_cast<file_handle*>(handle), O_PATH);
+  if (fd == -1) { return false; }
+  char target[PATH_MAX];
+  const auto procPath = "/proc/self/fd/" + std::to_string(fd);
+  const auto length = readlink(procPath.c_str(), target, sizeof(target) - 1);
+  close(fd);
+  if (length <= 0) { return false; }
+
+  out = fs::path(std::string(target, length));
+  if (fs::path ignored; toRelative(out, mRoot, ignored)) {
+    mDirectoryCache.emplace(std::move(key), out);
+    return true;
+  }
+  /// 根目录之外的目录只用来丢弃事件，淘汰后再次解析只多一次 open_by_handle_at
+  if (mOutsideOrder.size() >= MAX_OUTSIDE_DIRECTORIES) {
+    mOutsideCache.erase(mOutsideOrder.front());
+    mOutsideOrder.pop_front();
+  }
+  mOutsideOrder.push_back(key);
+  mOutsideCache.emplace(std::move(key), out);
+  return true;
+}
+
+void FanotifyWatcher::cacheDirectory(const fs::path& absolutePath) {
+  /// 新目录随时可能被删除，趁它还在时记下句柄，之后其子项的事件才能解析
+  struct {
+    file_handle handle;
+    unsigned char bytes[MAX_HANDLE_SZ];
+  } storage{};
+  storage.handle.handle_bytes = MAX_HANDLE_SZ;
+  int mountId = 0;
+  if (name_to_handle_at(AT_FDCWD, absolutePath.c_str(), &storage.handle, &mountId, 0) == 0) {
+    mDirectoryCache.insert_or_assign(handleKey(&storage.handle), absolutePath);
+  }
+}
+
+void FanotifyWatcher::renameDirectory(const fs::path& oldPath, const fs::path& newPath) {
+  for (auto* cache : {&mDirectoryCache, &mOutsideCache}) {
+    for (auto& cached : *cache | std::views::values) {
+      fs::path relative;
+      if (toRelative(cached, oldPath, relative)) {
+        cached = relative.empty() ? newPath : newPath / relative;
+      }
+    }
+  }
+  /// 移出根目录的子树不再留在不淘汰的缓存里
+  if (fs::path ignored; !toRelative(newPath, mRoot, ignored)) { forgetDirectory(newPath); }
+}
+
+void FanotifyWatcher::forgetDirectory(const fs::path& absolutePath) {
+  /// 目录删除后，其自身及所有子目录缓存的路径都已失效
+  for (auto* cache : {&mDirectoryCache, &mOutsideCache}) {
+    std::erase_if(*cache, [&](const auto& entry) {
+      fs::path ignored;
+      return toRelative(entry.second, absolutePath, ignored);
+    });
+  }
+}
+
+FanotifyWatcher::~FanotifyWatcher() {
+  if (mReadThread.joinable()) {
+    constexpr uint64_t stop = 1;
+    [[maybe_unused]] const auto written = write(mStopFd, &stop, sizeof(stop));
+    mReadThread.join();
+  }
+  if (mStopFd != -1) { close(mStopFd); }
+  if (mMountFd != -1) { close(mMountFd); }
+  if (mFanotifyFd != -1) { close(mFanotifyFd); }
+}
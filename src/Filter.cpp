@@ -2,19 +2,47 @@
 
 #pragma unmanaged
 
-Filter::Filter(const CallBackSignatur& callBack) {
+Filter::Filter()
+  : mCallbackHandle(0), mDirectSink(nullptr), mSinkContext(nullptr) {}
+
+Filter::Filter(const CallBackSignatur& callBack)
+  : mDirectSink(nullptr), mSinkContext(nullptr) {
   mCallbackHandle = registerCallback(callBack);
 }
 
-Filter::~Filter() { deRegisterCallback(mCallbackHandle); }
+Filter::Filter(const DirectSink sink, void* context)
+  : mCallbackHandle(0), mDirectSink(sink), mSinkContext(context) {}
+
+Filter::~Filter() {
+  if (mDirectSink == nullptr) { deRegisterCallback(mCallbackHandle); }
+}
 
 void Filter::sendError(const std::string& errorMsg) {
   std::vector<Event::uptr> events;
   events.emplace_back(std::make_unique<Event>(FAILED, errorMsg));
-  notify(std::move(events));
+  filterAndNotify(std::move(events));
 }
 
 void Filter::filterAndNotify(std::vector<Event::uptr>&& events) {
   if (events.empty()) { return; }
+  if (mDirectSink != nullptr) {
+    mDirectSink(mSinkContext, std::move(events));
+    return;
+  }
+  mSubscriptions.route(events);
   notify(std::move(events));
 }
+
+Filter::DirectSink Filter::directSink() const { return mDirectSink; }
+
+void* Filter::sinkContext() const { return mSinkContext; }
+
+SubscriptionTrie::Handle Filter::subscribe(const fs::path& prefix,
+                                           const CallBackSignatur& callBack,
+                                           const EventType mask) {
+  return mSubscriptions.subscribe(prefix, mask, callBack);
+}
+
+void Filter::unsubscribe(const SubscriptionTrie::Handle handle) {
+  mSubscriptions.unsubscribe(handle);
+}
@@ -0,0 +1,127 @@
+#include "fw/IdentityTracker.h"
+
+#include <sys/stat.h>
+
+namespace {
+bool isInside(const fs::path& path, const fs::path& ancestor) {
+  auto pathItr = path.begin();
+  for (const auto& part : ancestor) {
+    if (pathItr == path.end() || *pathItr != part) { return false; }
+    ++pathItr;
+  }
+  return true;
+}
+
+bool isRenamePair(const Event& from, const Event& to) {
+  return renamed(from.type) && deleted(from.type) && renamed(to.type) && created(to.type);
+}
+}
+
+IdentityTracker::IdentityTracker() : mEnabled(false) {}
+
+void IdentityTracker::configure(const fs::path& root) {
+  std::lock_guard lock(mIdentityMutex);
+  mRoot = root;
+  mEnabled = true;
+}
+
+bool IdentityTracker::isEnabled() const { return mEnabled; }
+
+bool IdentityTracker::stat(const fs::path& relPath, FileId& id) const {
+  struct stat status{};
+  if (::lstat((mRoot / relPath).c_str(), &status) != 0) { return false; }
+  id = {static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino)};
+  return true;
+}
+
+FileId IdentityTracker::known(const fs::path& relPath) const {
+  const auto itr = mIds.find(relPath);
+  return itr == mIds.end() ? FileId{} : itr->second;
+}
+
+void IdentityTracker::seed(const fs::path& relPath, const FileId& id) {
+  if (!mEnabled || !id.isKnown()) { return; }
+  std::lock_guard lock(mIdentityMutex);
+  mIds[relPath] = id;
+}
+
+void IdentityTracker::eraseSubtree(const fs::path& path) {
+  /// 按路径分量排序，子孙紧跟在 path 之后
+  auto itr = mIds.lower_bound(path);
+  while (itr != mIds.end() && isInside(itr->first, path)) {
+    itr = mIds.erase(itr);
+  }
+}
+
+void IdentityTracker::moveSubtree(const fs::path& from, const fs::path& to) {
+  std::vector<std::pair<fs::path, FileId>> moved;
+  auto itr = mIds.lower_bound(from);
+  while (itr != mIds.end() && isInside(itr->first, from)) {
+    moved.emplace_back(to / itr->first.lexically_relative(from), itr->second);
+    itr = mIds.erase(itr);
+  }
+  eraseSubtree(to);
+  for (auto& [path, id] : moved) {
+    /// lexically_relative 对 from 自身得到 "."
+    mIds[path.filename() == "." ? path.parent_path() : path] = id;
+  }
+}
+
+void IdentityTracker::annotate(std::vector<Event::uptr>& events) {
+  std::lock_guard lock(mIdentityMutex);
+  /// 本批次中被删除的路径及其身份，同一路径随后的新建即为原地替换
+  std::map<fs::path, FileId> removed;
+  const auto previousOf = [this, &removed](const fs::path& path) {
+    if (const auto id = known(path); id.isKnown()) { return id; }
+    const auto itr = removed.find(path);
+    return itr == removed.end() ? FileId{} : itr->second;
+  };
+
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    auto& event = *events[i];
+    const auto& path = event.relativePath;
+
+    if (buffer_overflow(event.type)) {
+      /// 丢失了事件，记录不再可信
+      mIds.clear();
+      removed.clear();
+      continue;
+    }
+    if (subtree_dirty(event.type)) {
+      eraseSubtree(path);
+      continue;
+    }
+    if ((event.type & (FAILED | SCAN_COMPLETE)) != NONE) { continue; }
+
+    if (i + 1 < events.size() && isRenamePair(event, *events[i + 1])) {
+      auto& target = *events[++i];
+      auto id = known(path);
+      if (!id.isKnown()) { stat(target.relativePath, id); }
+      if (const auto previous = previousOf(target.relativePath); previous.isKnown() && previous != id) {
+        target.replaced = previous;
+      }
+      moveSubtree(path, target.relativePath);
+      if (id.isKnown()) { mIds[target.relativePath] = id; }
+      event.id = target.id = id;
+      continue;
+    }
+
+    if (deleted(event.type)) {
+      event.id = known(path);
+      if (event.id.isKnown()) { removed[path] = event.id; }
+      eraseSubtree(path);
+      continue;
+    }
+
+    /// 已有记录来自遍历或此前的事件；替换总是先有删除或改名，记录已被清除
+    if (event.id = known(path); event.id.isKnown()) { continue; }
+    FileId id;
+    if (!stat(path, id)) { continue; }
+    if (const auto previous = previousOf(path); previous.isKnown() && previous != id) {
+      event.replaced = previous;
+      eraseSubtree(path);
+    }
+    mIds[path] = id;
+    event.id = id;
+  }
+}
@@ -1,20 +1,34 @@
 // ReSharper disable CppRedundantQualifier
 #include "fw/InotifyEventLoop.h"
+#include "fw/InotifyRecorder.h"
 
 #include <sys/ioctl.h>
 #include <csignal>
 #include <cstring>
 
 InotifyEventLooper::InotifyEventLooper(const int inotifyInstance,
-                                       const InotifyService::ptr inotifyService)
+                                       const InotifyService::ptr inotifyService,
+                                       InotifyRecorder* recorder,
+                                       const bool threaded,
+                                       const std::size_t shard)
   : mInotifyService(inotifyService)
+    , mRecorder(recorder)
     , mInotifyInstance(inotifyInstance)
-    , mRunning(true), mThreadStartedSemaphore(0) {
+    , mShard(shard)
+    , mRunning(threaded), mThreadStartedSemaphore(0) {
+  if (!threaded) { return; }
   mEventLoopThread = std::thread([this] { work(); });
   /// main loop
   mThreadStartedSemaphore.acquire();
 }
 
+InotifyEventLooper::InotifyEventLooper(const InotifyService::ptr inotifyService)
+  : mInotifyService(inotifyService)
+    , mRecorder(nullptr)
+    , mInotifyInstance(-1)
+    , mShard(0)
+    , mRunning(false), mThreadStartedSemaphore(0) {}
+
 bool InotifyEventLooper::isLooping() const { return mRunning; }
 
 void InotifyEventLooper::recordCreatedEvent(const inotify_event* event,
@@ -23,24 +37,24 @@ void InotifyEventLooper::recordCreatedEvent(const inotify_event* event,
   if (event == nullptr) { return; }
 
   if (isDirectoryEvent) {
-    mInotifyService->emitEventCreateDir(event->wd, event->name, sendInitEvents);
+    mInotifyService->emitEventCreateDir(mShard, event->wd, event->name, sendInitEvents);
   } else {
-    mInotifyService->emitEventCreate(event->wd, event->name);
+    mInotifyService->emitEventCreate(mShard, event->wd, event->name);
   }
 }
 
 void InotifyEventLooper::recordChangedEvent(const inotify_event* event) const {
   if (event == nullptr) { return; }
-  mInotifyService->emitEventModify(event->wd, event->name);
+  mInotifyService->emitEventModify(mShard, event->wd, event->name);
 }
 
 void InotifyEventLooper::recordDeletedEvent(const inotify_event* event, const bool isDir) const {
   if (event == nullptr) { return; }
 
   if (isDir) {
-    mInotifyService->emitEventDeleteDir(event->wd);
+    mInotifyService->emitEventDeleteDir(mShard, event->wd);
   } else {
-    mInotifyService->emitEventDelete(event->wd, event->name);
+    mInotifyService->emitEventDelete(mShard, event->wd, event->name);
   }
 }
 
@@ -54,25 +68,17 @@ void InotifyEventLooper::recordRenameNewEvent(const inotify_event* event,
                                               bool isDirectoryEvent,
                                               InotifyRenameEvent& renameEvent) const {
   if (!renameEvent.isGood) {
-    return recordCreatedEvent(event, isDirectoryEvent, false);
+    /// 从监听范围外移入的目录原有的内容也要报告，消费者之前从未见过它们
+    return recordCreatedEvent(event, isDirectoryEvent);
   }
 
   renameEvent.isGood = false;
 
-  if (renameEvent.cookie != event->cookie) {
-    if (renameEvent.isDirectory) {
-      mInotifyService->emitEventDeleteDir(renameEvent.wd, renameEvent.name);
-    }
-    mInotifyService->emitEventDelete(renameEvent.wd, renameEvent.name);
-
-    return recordCreatedEvent(event, isDirectoryEvent, false);
-  }
-
   if (renameEvent.isDirectory) {
-    mInotifyService->emitEventMoveDir(renameEvent.wd, renameEvent.name,
+    mInotifyService->emitEventMoveDir(mShard, renameEvent.wd, renameEvent.name,
                                       event->wd, event->name);
   } else {
-    mInotifyService->emitEventMove(renameEvent.wd, renameEvent.name,
+    mInotifyService->emitEventMove(mShard, renameEvent.wd, renameEvent.name,
                                    event->wd, event->name);
   }
 }
@@ -81,31 +87,74 @@ void InotifyEventLooper::work() {
   mThreadStartedSemaphore.release();
   while (mRunning) {
     constexpr int BUFFER_SIZE = 16384;
-    InotifyRenameEvent renameEvent;
     char buffer[BUFFER_SIZE];
     const auto bytesRead = read(mInotifyInstance, &buffer, BUFFER_SIZE);
     HANDLE_ERROR_CODE(bytesRead == 0, "没有读取到事件， InotifyEventLooper 线程结束.", break);
     HANDLE_ERROR_CODE(bytesRead == -1, strerror(errno), break);
-    ssize_t position = 0;
-    while (position < bytesRead) {
-      const auto* event = reinterpret_cast<inotify_event*>(buffer + position);
-      handleEvent(event, renameEvent);
-      position += sizeof(inotify_event) + event->len;
+    if (mRecorder != nullptr) {
+      mRecorder->recordBuffer(buffer, bytesRead);
     }
+    processBuffer(buffer, bytesRead);
     ssize_t bytesAvailable = 0;
     const auto erc = ioctl(mInotifyInstance, FIONREAD, &bytesAvailable);
     CONTINUE_LOOP_ON_CONDITION(erc < 0);
     CONTINUE_LOOP_ON_CONDITION(bytesAvailable != 0);
-    /// bytesAvailable为0的情况说明了inotify事件队列中当前没有任何事件等待处理。
-    /// 如果此时有挂起的重命名事件，需要进行相应的清理操作以避免信息丢失
-    CONTINUE_LOOP_ON_CONDITION(not renameEvent.isGood);
-    if (renameEvent.isDirectory) {
-      mInotifyService->emitEventDeleteDir(renameEvent.wd, renameEvent.name);
+    if (mRecorder != nullptr) {
+      mRecorder->recordDrain();
     }
-    mInotifyService->emitEventDelete(renameEvent.wd, renameEvent.name);
+    onQueueDrained();
   }
 }
 
+std::size_t InotifyEventLooper::pump() {
+  std::size_t buffers = 0;
+  while (true) {
+    constexpr int BUFFER_SIZE = 16384;
+    alignas(inotify_event) char buffer[BUFFER_SIZE];
+    const auto bytesRead = read(mInotifyInstance, &buffer, BUFFER_SIZE);
+    if (bytesRead == -1 && errno == EINTR) { continue; }
+    if (bytesRead == -1 && errno == EAGAIN) { break; }
+    HANDLE_ERROR_CODE(bytesRead == 0, "没有读取到事件， InotifyEventLooper 线程结束.", return buffers);
+    HANDLE_ERROR_CODE(bytesRead == -1, strerror(errno), return buffers);
+    if (mRecorder != nullptr) {
+      mRecorder->recordBuffer(buffer, bytesRead);
+    }
+    processBuffer(buffer, bytesRead);
+    ++buffers;
+  }
+  if (buffers > 0) {
+    if (mRecorder != nullptr) {
+      mRecorder->recordDrain();
+    }
+    onQueueDrained();
+  }
+  return buffers;
+}
+
+void InotifyEventLooper::processBuffer(const char* buffer, const ssize_t bytesRead) {
+  ssize_t position = 0;
+  while (position < bytesRead) {
+    const auto* event = reinterpret_cast<const inotify_event*>(buffer + position);
+    handleEvent(event, mRenameEvent);
+    position += sizeof(inotify_event) + event->len;
+  }
+}
+
+void InotifyEventLooper::onQueueDrained() {
+  /// bytesAvailable为0的情况说明了inotify事件队列中当前没有任何事件等待处理。
+  /// 如果此时有挂起的重命名事件，需要进行相应的清理操作以避免信息丢失
+  flushRenameEvent(mRenameEvent);
+}
+
+void InotifyEventLooper::flushRenameEvent(InotifyRenameEvent& renameEvent) const {
+  if (not renameEvent.isGood) { return; }
+  renameEvent.isGood = false;
+  if (renameEvent.isDirectory) {
+    mInotifyService->emitEventDeleteDir(mShard, renameEvent.wd, renameEvent.name);
+  }
+  mInotifyService->emitEventDelete(mShard, renameEvent.wd, renameEvent.name);
+}
+
 InotifyEventLooper::~InotifyEventLooper() {
   if (not mRunning) { return; }
   mRunning = false;
@@ -126,6 +175,19 @@ void InotifyEventLooper::handleEvent(const inotify_event* event, InotifyRenameEv
   const bool isDirectoryRemoval = event->mask & (IN_IGNORED | IN_DELETE_SELF);
   const bool isDirectoryEvent = event->mask & IN_ISDIR;
 
+  if (event->mask & IN_Q_OVERFLOW) {
+    /// 队列满后内核丢弃了之后的事件，挂起的改名另一半可能就在其中，先按删除结算
+    flushRenameEvent(renameEvent);
+    mInotifyService->emitEventOverflow();
+    return;
+  }
+
+  /// 挂起的移出只和紧随其后同 cookie 的移入配对；其它事件先把它按删除结算，
+  /// 否则之后在原路径上的创建和修改会先于这次删除送出，消费者以为文件已不在
+  if (renameEvent.isGood && event->cookie != renameEvent.cookie) {
+    flushRenameEvent(renameEvent);
+  }
+
   switch (event->mask & InotifyNode::ATTRIBUTES) {
   case IN_ATTRIB:
   case IN_MODIFY:
@@ -149,13 +211,10 @@ void InotifyEventLooper::handleEvent(const inotify_event* event, InotifyRenameEv
     } else recordRenameOldEvent(event, isDirectoryEvent, renameEvent);
     break;
   case IN_MOVE_SELF:
-    mInotifyService->emitEventDelete(event->wd, event->name);
-    mInotifyService->emitEventDeleteDir(event->wd);
+    mInotifyService->emitEventDelete(mShard, event->wd, event->name);
+    mInotifyService->emitEventDeleteDir(mShard, event->wd);
     break;
   default:
-    if (renameEvent.isGood && event->cookie != renameEvent.cookie) {
-      recordRenameNewEvent(event, isDirectoryEvent, renameEvent);
-    }
     break;
   }
 }
@@ -17,8 +17,7 @@ InotifyNode::InotifyNode(const InotifyTree::ptr tree,
     , mParent(parent) {
   const int event_mask = mParent != nullptr ? ATTRIBUTES : ATTRIBUTES | IN_MOVE_SELF;
 
-  mWatchDescriptor = inotify_add_watch(
-    mInotifyInstance, (mFileWatcherRoot / mRelativePath).c_str(), event_mask);
+  mWatchDescriptor = mTree->addWatch(mRelativePath, event_mask);
 
   mAlive = mWatchDescriptor != -1;
 
@@ -28,7 +27,7 @@ InotifyNode::InotifyNode(const InotifyTree::ptr tree,
     } else if (errno == EFAULT) {
       mTree->sendError("bad adress");
     } else if (errno == ENOSPC) {
-      mTree->sendError("No space left on device");
+      mTree->pollSubtree(mRelativePath, bSendInitEvent);
     } else if (errno == ENOMEM) {
       mTree->sendError("no mem");
     } else if (errno == EBADF || errno == EINVAL) {
@@ -38,32 +37,29 @@ InotifyNode::InotifyNode(const InotifyTree::ptr tree,
     return;
   }
 
-  std::error_code ec;
-  auto status = fs::status(mFileWatcherRoot / mRelativePath, ec);
-  if (ec || !is_directory(status) || is_symlink(status)) {
-    inotify_rm_watch(mInotifyInstance, mWatchDescriptor);
-    mAlive = false;
-    return;
-  }
-
   mWatchDescriptorInitialized = true;
+  if (const auto stale = mTree->getInotifyTreeByWatchDescriptor(mWatchDescriptor); stale != nullptr) {
+    releaseStaleNode(stale);
+  }
   mTree->addNodeReferenceByWD(mWatchDescriptor, this);
 
+  if (mTree->deferCrawl(mRelativePath, mWatchDescriptor, bSendInitEvent)) { return; }
   initRecursively(bSendInitEvent);
 }
 
 auto InotifyNode::initRecursively(const bool bSendInitEvent) -> void {
-  std::error_code ec;
-  auto dirItr = fs::directory_iterator(mFileWatcherRoot / mRelativePath, ec);
-  if (ec) { return; }
-  for (auto& child : dirItr) {
-    std::error_code statusEc;
-    auto status = fs::status(child);
-    if (statusEc || is_symlink(status)) { continue; }
-
-    const auto filename = child.path().filename();
+  std::vector<DirEntry> entries;
+  if (!mTree->listDirectory(mRelativePath, entries)) { return; }
+  addChildren(entries, bSendInitEvent);
+}
 
-    if (is_directory(status)) {
+void InotifyNode::addChildren(const std::vector<DirEntry>& entries,
+                              const bool bSendInitEvent) {
+  for (const auto& [filename, isDirectory, id] : entries) {
+    /// 渐进式启动时事件线程可能已经先一步建立了该子节点
+    if (mChildren.contains(filename)) { continue; }
+    mTree->seedIdentity(mRelativePath / filename, id);
+    if (isDirectory && !mTree->isExcluded(mRelativePath / filename)) {
       auto* childInotifyNode =
         new InotifyNode(mTree, mInotifyInstance,
                         this, mFileWatcherRoot,
@@ -74,6 +70,8 @@ auto InotifyNode::initRecursively(const bool bSendInitEvent) -> void {
       } else {
         delete childInotifyNode;
       }
+    } else {
+      mTree->seedTail(mRelativePath / filename);
     }
 
     if (bSendInitEvent) {
@@ -84,7 +82,7 @@ auto InotifyNode::initRecursively(const bool bSendInitEvent) -> void {
 
 InotifyNode::~InotifyNode() {
   if (mWatchDescriptorInitialized) {
-    inotify_rm_watch(mInotifyInstance, mWatchDescriptor);
+    mTree->removeWatch(mWatchDescriptor);
     mTree->removeNodeReferenceByWD(mWatchDescriptor);
   }
 
@@ -94,8 +92,30 @@ InotifyNode::~InotifyNode() {
   // delete mChildren;
 }
 
+void InotifyNode::releaseStaleNode(const InotifyNode::ptr stale) {
+  for (auto ancestor = mParent; ancestor != nullptr; ancestor = ancestor->mParent) {
+    if (ancestor == stale) { return; }
+  }
+  const auto parent = stale->mParent;
+  if (parent == nullptr || parent->getChildNode(stale->getName()) != stale) { return; }
+  parent->removeAndGetChildNode(stale->getName());
+  /// 子目录的 watch 各自独立，随旧子树一起移除，本节点遍历时重新建立
+  stale->mWatchDescriptorInitialized = false;
+  delete stale;
+}
+
 void InotifyNode::addChild(const fs::path& name,
                            const bool sendInitEvents) {
+  if (mTree->isExcluded(mRelativePath / name)) { return; }
+  if (const auto existing = getChildNode(name); existing != nullptr) {
+    /// 目录自己的 IN_DELETE_SELF 要等最后一个引用释放才到达，其间同名目录可能已被重建。
+    /// 同一个 inode 再次 add_watch 得到相同的 wd，不同时说明现有节点属于已删除的旧目录，换成新目录。
+    /// 相同时现有节点是处理旧目录的 IN_CREATE 时落到新目录上的，它遍历报告的内容排在旧目录的删除之前，
+    /// 已被那次删除作废，需要重新遍历
+    const int wd = mTree->addWatch(mRelativePath / name, ATTRIBUTES);
+    if (wd == -1 || (wd == existing->mWatchDescriptor && !sendInitEvents)) { return; }
+    removeChildNode(name);
+  }
   auto* child =
     new InotifyNode(mTree, mInotifyInstance, this, mFileWatcherRoot,
                     mRelativePath / name, sendInitEvents);
@@ -107,6 +127,11 @@ void InotifyNode::addChild(const fs::path& name,
   }
 }
 
+bool InotifyNode::watches(const fs::path& relPath) const {
+  const int wd = mTree->addWatch(relPath, ATTRIBUTES);
+  return wd == -1 || wd == mWatchDescriptor;
+}
+
 void InotifyNode::fixPaths() {
   const auto relPath = mParent->getRelativePath() / mRelativePath.filename();
   if (relPath == mRelativePath) return;
@@ -124,6 +149,11 @@ bool InotifyNode::isAlive() const { return mAlive; }
 
 InotifyNode::ptr InotifyNode::getParentNode() const { return mParent; }
 
+InotifyNode::ptr InotifyNode::getChildNode(const fs::path& name) const {
+  const auto itr = mChildren.find(name);
+  return itr == mChildren.end() ? nullptr : itr->second;
+}
+
 void InotifyNode::removeChildNode(const fs::path& name) {
   if (mChildren.contains(name)) {
     delete mChildren.at(name);
@@ -142,7 +172,10 @@ InotifyNode::ptr InotifyNode::removeAndGetChildNode(const fs::path& name) {
 }
 
 void InotifyNode::insertChildNode(const InotifyNode::ptr childNode) {
-  mChildren[childNode->getName()] = childNode;
+  /// 改名覆盖了同名空目录：旧节点的 watch 已失效，留下它会在本节点析构后持有悬空的父指针
+  auto& slot = mChildren[childNode->getName()];
+  if (slot != nullptr && slot != childNode) { delete slot; }
+  slot = childNode;
 }
 
 void InotifyNode::setNewParentNode(const fs::path& filename,
@@ -0,0 +1,62 @@
+#include "fw/InotifyRecorder.h"
+
+InotifyRecorder::InotifyRecorder(const fs::path& file, const fs::path& watchRoot)
+  : mOut(file, std::ios::binary | std::ios::trunc)
+    , mStart(std::chrono::steady_clock::now()) {
+  if (!mOut) { return; }
+  mOut.write(recording::MAGIC, sizeof(recording::MAGIC));
+  writeValue(recording::VERSION);
+  writeString(watchRoot.string());
+}
+
+bool InotifyRecorder::isOpen() const { return mOut.is_open() && mOut.good(); }
+
+void InotifyRecorder::recordWatch(const fs::path& relPath, const int wd, const int error) {
+  std::lock_guard lock(mWriteMutex);
+  writeRecordHeader(recording::RecordType::WATCH);
+  writeValue(static_cast<int32_t>(wd));
+  writeValue(static_cast<int32_t>(error));
+  writeString(relPath.string());
+}
+
+void InotifyRecorder::recordListing(const fs::path& relPath,
+                                    const std::vector<DirEntry>& entries) {
+  std::lock_guard lock(mWriteMutex);
+  writeRecordHeader(recording::RecordType::LISTING);
+  writeString(relPath.string());
+  writeValue(static_cast<uint32_t>(entries.size()));
+  for (const auto& entry : entries) {
+    writeValue(static_cast<uint8_t>(entry.isDirectory));
+    writeString(entry.name.string());
+  }
+}
+
+void InotifyRecorder::recordBuffer(const char* buffer, const std::size_t size) {
+  std::lock_guard lock(mWriteMutex);
+  writeRecordHeader(recording::RecordType::BUFFER);
+  writeValue(static_cast<uint32_t>(size));
+  mOut.write(buffer, static_cast<std::streamsize>(size));
+}
+
+void InotifyRecorder::recordDrain() {
+  std::lock_guard lock(mWriteMutex);
+  writeRecordHeader(recording::RecordType::DRAIN);
+  /// 队列排空是回放的同步点，顺便落盘，进程崩溃时也能保留到此为止的录制
+  mOut.flush();
+}
+
+void InotifyRecorder::writeRecordHeader(const recording::RecordType type) {
+  const auto elapsed = std::chrono::steady_clock::now() - mStart;
+  writeValue(static_cast<uint8_t>(type));
+  writeValue(static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+void InotifyRecorder::writeString(const std::string& value) {
+  writeValue(static_cast<uint32_t>(value.size()));
+  mOut.write(value.data(), static_cast<std::streamsize>(value.size()));
+}
+
+InotifyRecorder::~InotifyRecorder() {
+  if (mOut.is_open()) { mOut.flush(); }
+}
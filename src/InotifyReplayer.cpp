@@ -0,0 +1,162 @@
+#include "fw/InotifyReplayer.h"
+#include "fw/InotifyService.h"
+
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace {
+template <typename T>
+bool readValue(std::ifstream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool readString(std::ifstream& in, std::string& value) {
+  uint32_t size = 0;
+  if (!readValue(in, size)) { return false; }
+  value.resize(size);
+  return static_cast<bool>(in.read(value.data(), size));
+}
+}
+
+InotifyReplayer::InotifyReplayer(const Filter::sptr& filter,
+                                 const fs::path& recordingFile,
+                                 const std::chrono::milliseconds latency,
+                                 const Pace pace)
+  : mPace(pace), mLoaded(false), mCursor(0), mService(nullptr) {
+  mLoaded = load(recordingFile);
+  if (!mLoaded) {
+    filter->sendError("无法解析录制文件： " + recordingFile.string());
+    return;
+  }
+
+  /// 第一条 BUFFER 之前的记录就是初始快照
+  stageSideEffects();
+  mService = new InotifyService(filter, latency, this);
+}
+
+bool InotifyReplayer::isLoaded() const { return mLoaded; }
+
+fs::path InotifyReplayer::getWatchRoot() const { return mWatchRoot; }
+
+bool InotifyReplayer::load(const fs::path& recordingFile) {
+  std::ifstream in(recordingFile, std::ios::binary);
+  if (!in) { return false; }
+
+  char magic[sizeof(recording::MAGIC)];
+  uint16_t version = 0;
+  std::string root;
+  if (!in.read(magic, sizeof(magic)) ||
+    std::memcmp(magic, recording::MAGIC, sizeof(magic)) != 0 ||
+    !readValue(in, version) || version != recording::VERSION ||
+    !readString(in, root)) {
+    return false;
+  }
+  mWatchRoot = root;
+
+  uint8_t type = 0;
+  while (readValue(in, type)) {
+    Record record;
+    uint64_t nanos = 0;
+    if (!readValue(in, nanos)) { return false; }
+    record.type = static_cast<recording::RecordType>(type);
+    record.timestamp = std::chrono::nanoseconds(nanos);
+
+    std::string text;
+    switch (record.type) {
+    case recording::RecordType::WATCH: {
+      int32_t wd = 0, error = 0;
+      if (!readValue(in, wd) || !readValue(in, error) || !readString(in, text)) { return false; }
+      record.wd = wd;
+      record.error = error;
+      record.relPath = text;
+      break;
+    }
+    case recording::RecordType::LISTING: {
+      uint32_t count = 0;
+      if (!readString(in, text) || !readValue(in, count)) { return false; }
+      record.relPath = text;
+      for (uint32_t i = 0; i < count; ++i) {
+        uint8_t isDirectory = 0;
+        if (!readValue(in, isDirectory) || !readString(in, text)) { return false; }
+        record.entries.push_back({text, isDirectory != 0});
+      }
+      break;
+    }
+    case recording::RecordType::BUFFER:
+      if (!readString(in, record.bytes)) { return false; }
+      break;
+    case recording::RecordType::DRAIN:
+      break;
+    default:
+      return false;
+    }
+    mRecords.push_back(std::move(record));
+  }
+  return in.eof();
+}
+
+void InotifyReplayer::stageSideEffects() {
+  for (; mCursor < mRecords.size(); ++mCursor) {
+    auto& record = mRecords[mCursor];
+    if (record.type == recording::RecordType::WATCH) {
+      mWatches[record.relPath].emplace_back(record.wd, record.error);
+    } else if (record.type == recording::RecordType::LISTING) {
+      mListings[record.relPath].push_back(std::move(record.entries));
+    } else {
+      break;
+    }
+  }
+}
+
+std::size_t InotifyReplayer::replay() {
+  if (mService == nullptr || mService->mEventLoop == nullptr) { return 0; }
+
+  std::size_t buffers = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (mCursor < mRecords.size()) {
+    const auto& record = mRecords[mCursor++];
+    if (mPace == Pace::REAL_TIME) {
+      std::this_thread::sleep_until(start + record.timestamp);
+    }
+
+    if (record.type == recording::RecordType::BUFFER) {
+      /// 录制时该缓冲区处理过程中新增的 watch 紧随其后，先放入队列再处理
+      const auto& bytes = record.bytes;
+      stageSideEffects();
+      mService->mEventLoop->processBuffer(bytes.data(), static_cast<ssize_t>(bytes.size()));
+      ++buffers;
+    } else if (record.type == recording::RecordType::DRAIN) {
+      stageSideEffects();
+      mService->mEventLoop->onQueueDrained();
+      /// 录制时读取线程在这里读空了队列，此刻之前的事件作为一批投递
+      mService->mCollector->sendEvents();
+    }
+  }
+  mService->mCollector->flush();
+  return buffers;
+}
+
+int InotifyReplayer::takeWatch(const fs::path& relPath, int& error) {
+  const auto itr = mWatches.find(relPath);
+  if (itr == mWatches.end() || itr->second.empty()) {
+    error = ENOENT;
+    return -1;
+  }
+  const auto [wd, recordedError] = itr->second.front();
+  itr->second.pop_front();
+  error = recordedError;
+  return wd;
+}
+
+bool InotifyReplayer::takeListing(const fs::path& relPath, std::vector<DirEntry>& out) {
+  const auto itr = mListings.find(relPath);
+  if (itr == mListings.end() || itr->second.empty()) { return false; }
+  out = std::move(itr->second.front());
+  itr->second.pop_front();
+  return true;
+}
+
+InotifyReplayer::~InotifyReplayer() {
+  delete mService;
+}
@@ -1,22 +1,151 @@
 #include "fw/InotifyService.h"
+#include "fw/InotifyRecorder.h"
+#include "fw/PollingScanner.h"
+#include "fw/FanotifyWatcher.h"
+#include "fw/UringCrawler.h"
+#include "fw/InotifyReplayer.h"
+
+#include <sys/epoll.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace {
+bool isThreadless(const WatchOptions& options) {
+  return options.threadless && options.backend == WatchBackend::INOTIFY;
+}
+}
 
 InotifyService::InotifyService(const std::shared_ptr<Filter>& filter,
                                const fs::path& path,
                                const std::chrono::milliseconds latency)
+  : InotifyService(filter, path, latency, WatchOptions{}) {}
+
+InotifyService::InotifyService(const std::shared_ptr<Filter>& filter,
+                               const fs::path& path,
+                               const std::chrono::milliseconds latency,
+                               const WatchOptions& options)
   : mEventLoop(nullptr)
-    , mCollector(std::make_shared<Collector>(filter, latency))
-    , mTree(nullptr) {
-  mInotifyInstance = inotify_init();
+    , mCollector(std::make_shared<Collector>(filter, latency, options.initEventChunkSize,
+                                           options.aggregationThreshold,
+                                           options.aggregationWindow,
+                                           options.coalesceEvents,
+                                           !isThreadless(options)))
+    , mTree(nullptr)
+    , mRecorder(nullptr)
+    , mPoller(nullptr)
+    , mFanotify(nullptr)
+    , mCrawler(nullptr)
+    , mInotifyInstance(-1)
+    , mPollFd(-1)
+    , mRootPath(path.lexically_normal())
+    , mPriorityPaths(options.priorityPaths) {
+  if (options.threadless && !isThreadless(options)) {
+    mCollector->sendError("无线程模式仅支持 inotify 后端，已退回线程模式");
+  }
+  if (!options.tailPatterns.empty()) {
+    mCollector->enableTailing(path, options.tailPatterns);
+  }
+  /// 基线扫描在建立任何 watch 之前完成，之后的变化都应当以事件的形式到达
+  if (options.auditInterval.count() > 0) {
+    mCollector->enableAudit(new ConsistencyAuditor(path, options.auditInterval, options.onAudit));
+  }
+  if (options.fileIdentity) {
+    mCollector->enableIdentity(path);
+  }
+  if (!options.journalDirectory.empty()) {
+    auto* journal = new EventJournal(options.journalDirectory, options.journalSegmentBytes);
+    if (journal->isOpen()) {
+      mCollector->enableJournal(journal);
+    } else {
+      mCollector->sendError("无法打开事件日志： " + options.journalDirectory.string());
+      delete journal;
+    }
+  }
+
+  if (options.backend == WatchBackend::FANOTIFY) {
+    if (!exists(path)) {
+      mCollector->sendError("路径不存在");
+      return;
+    }
+    mFanotify = new FanotifyWatcher(path, mCollector);
+    return;
+  }
+
+  mPoller = new PollingScanner(path, mCollector, options.pollMinInterval,
+                               options.pollMaxInterval, options.pollBudget);
+  if (options.backend == WatchBackend::POLLING) {
+    if (!exists(path)) {
+      mCollector->sendError("路径不存在");
+      return;
+    }
+    mPoller->addSubtree(fs::path(""), false);
+    return;
+  }
+
+  const bool threadless = isThreadless(options);
+  mInotifyInstance = threadless ? inotify_init1(IN_NONBLOCK | IN_CLOEXEC) : inotify_init();
 
   if (mInotifyInstance == -1) {
     mCollector->sendError("inotify_init 失败");
     return;
   }
 
-  mTree = new InotifyTree(mInotifyInstance, path, mCollector);
+  if (threadless) {
+    mPollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    for (const int fd : {mInotifyInstance, mCollector->wakeFd()}) {
+      event.data.fd = fd;
+      if (mPollFd == -1 || epoll_ctl(mPollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        mCollector->sendError("epoll 初始化失败： " + std::string(strerror(errno)));
+        return;
+      }
+    }
+  }
+
+  if (!options.recordingFile.empty()) {
+    mRecorder = new InotifyRecorder(options.recordingFile, path);
+    if (!mRecorder->isOpen()) {
+      mCollector->sendError("无法创建录制文件： " + options.recordingFile.string());
+      delete mRecorder;
+      mRecorder = nullptr;
+    }
+  }
+
+  if (options.ioUringCrawl) {
+    mCrawler = new UringCrawler();
+    if (!mCrawler->isAvailable()) {
+      delete mCrawler;
+      mCrawler = nullptr;
+    }
+  }
+
+  /// 分片实例先于主树建立，任何一个失败都退回单实例
+  if (options.inotifyShards > 1 && !threadless && mRecorder == nullptr) {
+    for (std::size_t i = 0; i < options.inotifyShards; ++i) {
+      auto* shard = new Shard();
+      shard->instance = inotify_init();
+      if (shard->instance == -1) {
+        mCollector->sendError("分片 inotify_init 失败，退回单实例： " + std::string(strerror(errno)));
+        delete shard;
+        for (const auto* created : mShards) {
+          close(created->instance);
+          delete created;
+        }
+        mShards.clear();
+        break;
+      }
+      mShards.push_back(shard);
+    }
+  }
+
+  mTree = new InotifyTree(mInotifyInstance, path, mCollector, mRecorder, mPoller, mCrawler, options,
+                          fs::path(), false, !mShards.empty());
   if (mTree->isRootAlive()) {
+    if (!mShards.empty()) { startShards(); }
     /// 实例化即启动 .wait()
-    mEventLoop = new InotifyEventLooper(mInotifyInstance, this);
+    mEventLoop = new InotifyEventLooper(mInotifyInstance, this, mRecorder, !threadless);
   } else {
     delete mTree;
     mTree = nullptr;
@@ -24,95 +153,447 @@ InotifyService::InotifyService(const std::shared_ptr<Filter>& filter,
   }
 }
 
+InotifyService::InotifyService(const std::shared_ptr<Filter>& filter,
+                               const std::chrono::milliseconds latency,
+                               InotifyReplayer* replayer)
+  : mEventLoop(nullptr)
+    /// 回放线程独自驱动 Collector，不启动它自己的线程，投递顺序与批次划分只取决于录制内容
+    , mCollector(std::make_shared<Collector>(filter, latency, 1024, 0, std::chrono::milliseconds(1000), true, false))
+    , mTree(nullptr)
+    , mRecorder(nullptr)
+    , mPoller(nullptr)
+    , mFanotify(nullptr)
+    , mCrawler(nullptr)
+    , mInotifyInstance(-1)
+    , mPollFd(-1)
+    , mRootPath(replayer->getWatchRoot()) {
+  mTree = new InotifyTree(replayer, mCollector);
+  if (mTree->isRootAlive()) {
+    mEventLoop = new InotifyEventLooper(this);
+  } else {
+    delete mTree;
+    mTree = nullptr;
+  }
+}
+
 InotifyService::~InotifyService() {
   delete mEventLoop;
+  for (const auto* shard : mShards) { delete shard->loop; }
+  for (const auto* shard : mShards) {
+    for (const auto* tree : shard->trees) { delete tree; }
+    close(shard->instance);
+    delete shard;
+  }
+  delete mFanotify;
+  /// 树的析构会停止并等待渐进式遍历线程，遍历中仍可能用到轮询扫描器与 io_uring，先删树
+  for (const auto* tree : mAttachedTrees) { delete tree; }
   delete mTree;
-  close(mInotifyInstance);
+  delete mPoller;
+  delete mCrawler;
+  delete mRecorder;
+  if (mInotifyInstance != -1) { close(mInotifyInstance); }
+  if (mPollFd != -1) { close(mPollFd); }
+}
+
+int InotifyService::pollFd() const { return mPollFd; }
+
+void InotifyService::pump() {
+  if (mPollFd == -1) { return; }
+  if (mEventLoop != nullptr) { mEventLoop->pump(); }
+  mCollector->sendEvents();
+  mCollector->rearm();
+}
+
+void InotifyService::wake() const { mCollector->wake(); }
+
+void InotifyService::emitEventCreate(const std::size_t shard, const int wd, const fs::path& name) const {
+  dispatchEvent(shard, CREATED, wd, name);
 }
 
-void InotifyService::emitEventCreate(const int wd, const fs::path& name) const {
-  dispatchEvent(CREATED, wd, name);
+WatchOptions InotifyService::subtreeOptions(const fs::path& prefix) const {
+  WatchOptions options;
+  options.progressiveStartup = true;
+  for (const auto& priorityPath : mPriorityPaths) {
+    const auto relative = priorityPath.lexically_relative(prefix);
+    if (relative.empty() || *relative.begin() == "..") {
+      /// 附加树落在优先路径之下时整棵树都优先
+      if (const auto up = prefix.lexically_relative(priorityPath); !up.empty() && *up.begin() != "..") {
+        options.priorityPaths.emplace_back();
+      }
+      continue;
+    }
+    options.priorityPaths.push_back(relative == "." ? fs::path() : relative);
+  }
+  return options;
 }
 
 void InotifyService::sendError(const std::string& errorMsg) const {
   mCollector->sendError(errorMsg);
 }
 
-void InotifyService::dispatchEvent(EventType actionOld,
+void InotifyService::dispatchEvent(const std::size_t shard,
+                                   EventType actionOld,
                                    const int wdOld,
                                    const fs::path& nameOld,
                                    EventType actionNew,
                                    const int wdNew,
                                    const fs::path& nameNew) const {
-  std::vector<Event::uptr> result;
+  std::lock_guard lock(mutexFor(shard));
   fs::path pathOld;
-  if (!mTree->getRelPath(pathOld, wdOld)) {
-    return;
-  }
-  result.emplace_back(std::make_unique<Event>(actionOld, pathOld / nameOld));
-
+  const auto treeOld = treeFor(shard, wdOld);
+  const bool hasOld = treeOld != nullptr && treeOld->getRelPath(pathOld, wdOld);
   fs::path pathNew;
-  if (!mTree->getRelPath(pathNew, wdNew)) {
+  const auto treeNew = treeFor(shard, wdNew);
+  const bool hasNew = treeNew != nullptr && treeNew->getRelPath(pathNew, wdNew);
+  /// 一端所在的目录已不在树中（已删除或移走）时，另一端按不成对的删除或创建报告，不能整对丢掉
+  if (!hasOld || !hasNew) {
+    if (hasOld) { mCollector->collect(actionOld & ~RENAMED, pathOld / nameOld); }
+    if (hasNew) { mCollector->collect(actionNew & ~RENAMED, pathNew / nameNew); }
     return;
   }
-  result.emplace_back(std::make_unique<Event>(actionNew, pathNew / nameNew));
 
+  std::vector<Event::uptr> result;
+  result.emplace_back(std::make_unique<Event>(actionOld, pathOld / nameOld));
+  result.emplace_back(std::make_unique<Event>(actionNew, pathNew / nameNew));
   mCollector->insert(std::move(result));
 }
 
-void InotifyService::dispatchEvent(const EventType action,
+void InotifyService::dispatchEvent(const std::size_t shard,
+                                   const EventType action,
                                    const int wd,
                                    const fs::path& name) const {
+  std::lock_guard lock(mutexFor(shard));
   fs::path path;
-  if (!mTree->getRelPath(path, wd)) {
+  const auto tree = treeFor(shard, wd);
+  if (tree == nullptr || !tree->getRelPath(path, wd)) {
     return;
   }
+  /// 分片树根目录自身的移动与删除已由主实例在根目录上报告
+  if (shard != 0 && name.empty() && tree->isRoot(wd)) { return; }
 
   mCollector->collect(action, std::move(path / name));
 }
 
 bool InotifyService::isWatching() const {
+  if (mFanotify != nullptr) {
+    return mFanotify->isWatching();
+  }
+  if (mTree == nullptr && mPoller != nullptr) {
+    return mPoller->isPolling();
+  }
   if (mTree == nullptr || mEventLoop == nullptr) {
     return false;
   }
 
-  return mTree->isRootAlive() && mEventLoop->isLooping();
+  return mTree->isRootAlive() && (mPollFd != -1 || mEventLoop->isLooping());
 }
 
-void InotifyService::emitEventModify(const int wd, const fs::path& name) const {
-  dispatchEvent(CHANGED, wd, name);
+bool InotifyService::isReady() const {
+  if (mTree == nullptr) {
+    return isWatching();
+  }
+  return mTree->isReady();
+}
+
+void InotifyService::emitEventModify(const std::size_t shard, const int wd, const fs::path& name) const {
+  dispatchEvent(shard, CHANGED, wd, name);
 }
 
-void InotifyService::emitEventCreateDir(const int wd,
+void InotifyService::emitEventCreateDir(const std::size_t shard,
+                                        const int wd,
                                         const fs::path& name,
                                         const bool sendInitEvents) const {
-  if (!mTree->nodeExists(wd)) { return; }
-  mTree->addDirNode(wd, name, sendInitEvents);
-  dispatchEvent(CREATED, wd, name);
+  std::lock_guard lock(mutexFor(shard));
+  const auto tree = treeFor(shard, wd);
+  if (tree == nullptr) { return; }
+  /// 分片模式下跨分片移入的目录与从树外移入无法区分，一律报告其内容
+  const bool reportContents = sendInitEvents || !mShards.empty();
+  if (isTopLevel(shard, tree, wd)) {
+    if (!mTree->isUnwatched(name)) { attachTopLevel(name, reportContents); }
+  } else {
+    tree->addDirNode(wd, name, reportContents);
+  }
+  dispatchEvent(shard, CREATED, wd, name);
 }
 
-void InotifyService::emitEventDelete(const int wd, const fs::path& name) const {
-  dispatchEvent(DELETED, wd, name);
+void InotifyService::emitEventDelete(const std::size_t shard, const int wd, const fs::path& name) const {
+  std::lock_guard lock(mutexFor(shard));
+  dispatchEvent(shard, DELETED, wd, name);
+  if (isTopLevel(shard, treeFor(shard, wd), wd)) { detachTopLevel(name); }
 }
-void InotifyService::emitEventDeleteDir(const int wd) const {
-  mTree->removeDirNode(wd);
+void InotifyService::emitEventDeleteDir(const std::size_t shard, const int wd) const {
+  std::lock_guard lock(mutexFor(shard));
+  const auto tree = treeFor(shard, wd);
+  if (tree == nullptr || (shard != 0 && tree->isRoot(wd))) { return; }
+  tree->removeDirNode(wd);
 }
-void InotifyService::emitEventDeleteDir(const int wd, const fs::path& name) const {
-  mTree->removeDirNode(wd, name);
+void InotifyService::emitEventDeleteDir(const std::size_t shard, const int wd, const fs::path& name) const {
+  std::lock_guard lock(mutexFor(shard));
+  const auto tree = treeFor(shard, wd);
+  if (tree == nullptr) { return; }
+  tree->removeDirNode(wd, name);
+  if (isTopLevel(shard, tree, wd)) { detachTopLevel(name); }
 }
 
-void InotifyService::emitEventMove(const int wdOld,
+void InotifyService::emitEventMove(const std::size_t shard,
+                                   const int wdOld,
                                    const fs::path& nameOld,
                                    const int wdNew,
                                    const fs::path& nameNew) const {
-  /// TODO 只保留RENAMED就够了
-  dispatchEvent(DELETED | RENAMED, wdOld, nameOld, CREATED | RENAMED, wdNew, nameNew);
+  /// 改名报告为相邻的一对：旧路径 DELETED|RENAMED、新路径 CREATED|RENAMED。单个事件只有一个路径，
+  /// 合并、订阅路由、日志合并与追踪都按这一形状配对，不改成单个 RENAMED
+  dispatchEvent(shard, DELETED | RENAMED, wdOld, nameOld, CREATED | RENAMED, wdNew, nameNew);
 }
 
-void InotifyService::emitEventMoveDir(const int wdOld,
+void InotifyService::emitEventMoveDir(const std::size_t shard,
+                                      const int wdOld,
                                       const fs::path& nameOld,
                                       const int wdNew,
                                       const fs::path& newName) const {
-  emitEventMove(wdOld, nameOld, wdNew, newName);
-  mTree->moveDirNode(wdOld, nameOld, wdNew, newName);
+  std::lock_guard lock(mutexFor(shard));
+  const auto treeOld = treeFor(shard, wdOld);
+  const auto treeNew = treeFor(shard, wdNew);
+  /// 源节点属于之后的同名目录时按不成对的移出加移入报告：移出作废旧路径下已报告的内容，
+  /// 移入报告目标目录的真实内容；同名目录由队列中它自己的 IN_CREATE 重新建立。
+  /// 两棵树属于同一个 inotify 实例，跨树移动也能按 wd 判断
+  fs::path target;
+  if (treeOld != nullptr && treeNew != nullptr && !isTopLevel(shard, treeOld, wdOld) &&
+    treeNew->getRelPath(target, wdNew) && treeOld->isStaleMove(wdOld, nameOld, target / newName)) {
+    emitEventDeleteDir(shard, wdOld, nameOld);
+    emitEventDelete(shard, wdOld, nameOld);
+    emitEventCreateDir(shard, wdNew, newName, true);
+    return;
+  }
+  emitEventMove(shard, wdOld, nameOld, wdNew, newName);
+  /// 顶层子目录改名：主实例只监听根目录，两端都在根目录下，整棵树换到新名字所属的分片
+  if (isTopLevel(shard, treeOld, wdOld)) {
+    detachTopLevel(nameOld);
+    if (!mTree->isUnwatched(newName)) { attachTopLevel(newName, false); }
+    return;
+  }
+  /// 跨树移动：从旧树摘除，新树中找不到 wdOld 会按新建目录遍历
+  if (treeOld != nullptr && treeOld != treeNew) { treeOld->removeDirNode(wdOld, nameOld); }
+  if (treeNew != nullptr) { treeNew->moveDirNode(wdOld, nameOld, wdNew, newName); }
+}
+
+void InotifyService::emitEventOverflow() const {
+  mCollector->collect(OVERFLOW, fs::path());
+}
+
+std::recursive_mutex& InotifyService::mutexFor(const std::size_t shard) const {
+  return shard == 0 ? mTreesMutex : mShards[shard - 1]->mutex;
+}
+
+InotifyTree* InotifyService::treeFor(const std::size_t shard, const int wd) const {
+  if (shard != 0) {
+    for (auto* tree : mShards[shard - 1]->trees) {
+      if (tree->nodeExists(wd)) { return tree; }
+    }
+    return nullptr;
+  }
+  if (mTree != nullptr && mTree->nodeExists(wd)) { return mTree; }
+  for (auto* tree : mAttachedTrees) {
+    if (tree->nodeExists(wd)) { return tree; }
+  }
+  return nullptr;
+}
+
+bool InotifyService::isTopLevel(const std::size_t shard, const InotifyTree* tree, const int wd) const {
+  return shard == 0 && !mShards.empty() && tree != nullptr && tree == mTree && mTree->isRoot(wd);
+}
+
+void InotifyService::startShards() {
+  /// 各分片在自己的线程上遍历分到的顶层子目录，启动耗时随分片数下降
+  std::vector<std::vector<fs::path>> assigned(mShards.size());
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(mRootPath, ec)) {
+    std::error_code statusEc;
+    if (entry.is_symlink(statusEc) || !entry.is_directory(statusEc)) { continue; }
+    const auto name = entry.path().filename();
+    const auto index = std::find(mShards.begin(), mShards.end(), shardOf(name)) - mShards.begin();
+    assigned[index].push_back(name);
+  }
+
+  std::vector<std::thread> walkers;
+  for (const auto& names : assigned) {
+    walkers.emplace_back([this, &names] {
+      for (const auto& name : names) { attachTopLevel(name, false); }
+    });
+  }
+  for (auto& walker : walkers) { walker.join(); }
+
+  for (std::size_t i = 0; i < mShards.size(); ++i) {
+    mShards[i]->loop = new InotifyEventLooper(mShards[i]->instance, this, nullptr, true, i + 1);
+  }
+}
+
+InotifyService::Shard* InotifyService::shardOf(const fs::path& name) const {
+  return mShards[std::hash<std::string>{}(name.string()) % mShards.size()];
+}
+
+bool InotifyService::attachTopLevel(const fs::path& name, const bool sendInitEvents) const {
+  if (name.empty() || mShards.empty()) { return false; }
+  auto* shard = shardOf(name);
+  /// 持有分片锁遍历：新 watch 的事件要等树登记后才能被该分片的读取线程处理
+  std::lock_guard lock(shard->mutex);
+  detachTopLevel(name);
+  /// 事件处理到这里时目录可能已经又被移走，这是正常的竞争，不必当作错误上报
+  if (std::error_code ec; !fs::is_directory(mRootPath / name, ec)) { return false; }
+  /// 与其他附加树共用服务的选项，但必须同步遍历完才能登记
+  auto options = subtreeOptions(name);
+  options.progressiveStartup = false;
+  auto* tree = new InotifyTree(shard->instance, mRootPath / name, mCollector, nullptr, mPoller, mCrawler,
+                               options, name, sendInitEvents);
+  if (!tree->isRootAlive()) {
+    delete tree;
+    return false;
+  }
+  shard->trees.push_back(tree);
+  return true;
+}
+
+void InotifyService::detachTopLevel(const fs::path& name) const {
+  if (name.empty() || mShards.empty()) { return; }
+  auto* shard = shardOf(name);
+  std::lock_guard lock(shard->mutex);
+  std::erase_if(shard->trees, [&name](const InotifyTree* tree) {
+    if (tree->getEventPrefix() != name) { return false; }
+    delete tree;
+    return true;
+  });
+}
+
+fs::path InotifyService::topLevelOf(const fs::path& relative) const {
+  if (mShards.empty() || relative.empty() || *relative.begin() == ".." || *relative.begin() == ".") {
+    return {};
+  }
+  return *relative.begin();
+}
+
+InotifyTree* InotifyService::treeForPath(const fs::path& absolute, fs::path& relative) const {
+  const auto within = [&absolute, &relative](const fs::path& root) {
+    auto rootItr = root.begin();
+    auto pathItr = absolute.begin();
+    for (; rootItr != root.end(); ++rootItr, ++pathItr) {
+      if (rootItr->empty()) { continue; }
+      if (pathItr == absolute.end() || *rootItr != *pathItr) { return false; }
+    }
+    relative.clear();
+    for (; pathItr != absolute.end(); ++pathItr) {
+      if (!pathItr->empty()) { relative /= *pathItr; }
+    }
+    return true;
+  };
+  if (mTree != nullptr && within(mRootPath)) { return mTree; }
+  for (auto* tree : mAttachedTrees) {
+    if (within(tree->getRoot())) { return tree; }
+  }
+  return nullptr;
+}
+
+bool InotifyService::watch(const fs::path& path) {
+  if (mTree == nullptr || mInotifyInstance == -1) {
+    sendError("只有 inotify 后端支持运行时增加监听");
+    return false;
+  }
+  /// 录制文件只描述启动时的目录树，回放无法重现运行时增加的监听
+  if (mRecorder != nullptr) {
+    sendError("录制时不支持运行时增加监听");
+    return false;
+  }
+  const auto absolute = (path.is_absolute() ? path : mRootPath / path).lexically_normal();
+
+  std::lock_guard lock(mTreesMutex);
+  const auto inRoot = absolute.lexically_relative(mRootPath);
+  if (const auto name = topLevelOf(inRoot); !name.empty()) {
+    if (inRoot == name) {
+      mTree->watchSubtree(name);
+      return attachTopLevel(name, false);
+    }
+    auto* shard = shardOf(name);
+    std::lock_guard shardLock(shard->mutex);
+    for (auto* tree : shard->trees) {
+      if (tree->getEventPrefix() == name) { return tree->watchSubtree(inRoot.lexically_relative(name)); }
+    }
+    sendError("父目录未被监听： " + absolute.string());
+    return false;
+  }
+
+  fs::path relative;
+  if (auto* tree = treeForPath(absolute, relative)) {
+    return tree->watchSubtree(relative);
+  }
+  /// 新根目录是已有根目录的祖先时会重复监听，拒绝
+  const auto coversRoot = [&absolute](const fs::path& root) {
+    const auto rel = root.lexically_relative(absolute);
+    return !rel.empty() && *rel.begin() != "..";
+  };
+  if (coversRoot(mRootPath) || std::ranges::any_of(mAttachedTrees, [&](const InotifyTree* attached) {
+    return coversRoot(attached->getRoot());
+  })) {
+    sendError("不能附加已监听目录的祖先： " + absolute.string());
+    return false;
+  }
+  if (!exists(absolute)) {
+    sendError("路径不存在： " + absolute.string());
+    return false;
+  }
+
+  /// 渐进式遍历：构造函数只监听根目录即返回，持锁时间很短，子树由后台线程遍历，期间事件照常处理
+  const auto prefix = absolute.lexically_relative(mRootPath);
+  auto* tree = new InotifyTree(mInotifyInstance, absolute, mCollector, nullptr, mPoller, mCrawler,
+                               subtreeOptions(prefix), prefix);
+  if (!tree->isRootAlive()) {
+    delete tree;
+    return false;
+  }
+  mAttachedTrees.push_back(tree);
+  return true;
+}
+
+bool InotifyService::unwatch(const fs::path& path) {
+  if (mTree == nullptr) {
+    sendError("只有 inotify 后端支持运行时取消监听");
+    return false;
+  }
+  if (mRecorder != nullptr) {
+    sendError("录制时不支持运行时取消监听");
+    return false;
+  }
+  const auto absolute = (path.is_absolute() ? path : mRootPath / path).lexically_normal();
+
+  InotifyTree* detached = nullptr;
+  {
+    std::lock_guard lock(mTreesMutex);
+    const auto inRoot = absolute.lexically_relative(mRootPath);
+    if (const auto name = topLevelOf(inRoot); !name.empty()) {
+      if (inRoot == name) {
+        mTree->unwatchSubtree(name);
+        detachTopLevel(name);
+        return true;
+      }
+      auto* shard = shardOf(name);
+      std::lock_guard shardLock(shard->mutex);
+      for (auto* tree : shard->trees) {
+        if (tree->getEventPrefix() == name) { return tree->unwatchSubtree(inRoot.lexically_relative(name)); }
+      }
+      sendError("未被监听： " + absolute.string());
+      return false;
+    }
+
+    fs::path relative;
+    auto* tree = treeForPath(absolute, relative);
+    if (tree == nullptr) {
+      sendError("未被监听： " + absolute.string());
+      return false;
+    }
+    if (tree == mTree || !relative.empty()) {
+      return tree->unwatchSubtree(relative);
+    }
+    std::erase(mAttachedTrees, tree);
+    detached = tree;
+  }
+  /// 已从查找表中摘除，事件线程不会再拿到它；析构会等待其遍历线程结束
+  delete detached;
+  return true;
 }
@@ -1,18 +1,65 @@
 #include "fw/InotifyTree.h"
+#include "fw/InotifyRecorder.h"
+#include "fw/InotifyReplayer.h"
+#include "fw/PollingScanner.h"
+#include "fw/UringCrawler.h"
+
+#include <sys/stat.h>
+
+namespace {
+bool isInside(const fs::path& path, const fs::path& ancestor) {
+  auto pathItr = path.begin();
+  for (const auto& part : ancestor) {
+    if (pathItr == path.end() || *pathItr != part) { return false; }
+    ++pathItr;
+  }
+  return true;
+}
+}
 
 InotifyTree::InotifyTree(const int inotifyInstance,
                          const fs::path& path,
-                         std::shared_ptr<Collector> collector)
+                         std::shared_ptr<Collector> collector,
+                         InotifyRecorder* recorder,
+                         PollingScanner* poller,
+                         UringCrawler* crawler,
+                         const WatchOptions& options,
+                         fs::path eventPrefix,
+                         const bool sendInitEvents,
+                         const bool delegateTopLevel)
   : mCollector(std::move(std::move(collector)))
     , mInotifyInstance(inotifyInstance)
-    , mRoot(nullptr) {
+    , mRootPath(path)
+    , mEventPrefix(std::move(eventPrefix))
+    , mDelegateTopLevel(delegateTopLevel)
+    , mRecorder(recorder)
+    , mReplayer(nullptr)
+    , mPoller(poller)
+    , mCrawler(crawler)
+    , mRoot(nullptr)
+    , mProgressive(options.progressiveStartup && recorder == nullptr)
+    , mStopCrawl(false)
+    , mSpaceExhausted(false)
+    , mCrawlSequence(0)
+    , mWatchedDirectories(0)
+    , mInitScanSequence(0)
+    , mCurrentInitScan(0)
+    , mPriorityPaths(options.priorityPaths)
+    , mOnStartupProgress(options.onStartupProgress) {
   if (!exists(path)) {
     mCollector->sendError("路径不存在");
     return;
   }
 
+  /// sendInitEvents：整棵树作为一个新出现的目录报告其内容（分片接管运行时新建的顶层目录）
+  const auto scanId = sendInitEvents ? beginInitScan(fs::path()) : 0;
+  mCurrentInitScan = scanId;
   mRoot = new InotifyNode(this, mInotifyInstance, nullptr, path,
-                          fs::path(""), false);
+                          fs::path(""), sendInitEvents);
+  mCurrentInitScan = 0;
+  finishInitScan(scanId);
+  /// 构造线程可能是分片的遍历线程或调用 watch() 的线程，之后未必还会遍历
+  finishCrawl(true);
 
   if (!mRoot->isAlive()) {
     mCollector->sendError("意外终止。");
@@ -20,10 +67,256 @@ InotifyTree::InotifyTree(const int inotifyInstance,
     mRoot = nullptr;
     return;
   }
+
+  if (mProgressive) {
+    mCrawlThread = std::thread(&InotifyTree::crawl, this);
+  } else {
+    reportProgress(true);
+  }
+}
+
+InotifyTree::InotifyTree(InotifyReplayer* replayer,
+                         std::shared_ptr<Collector> collector)
+  : mCollector(std::move(collector))
+    , mInotifyInstance(-1)
+    , mRootPath(replayer->getWatchRoot())
+    , mEventPrefix()
+    , mDelegateTopLevel(false)
+    , mRecorder(nullptr)
+    , mReplayer(replayer)
+    , mPoller(nullptr)
+    , mCrawler(nullptr)
+    , mRoot(nullptr)
+    , mProgressive(false)
+    , mStopCrawl(false)
+    , mSpaceExhausted(false)
+    , mCrawlSequence(0)
+    , mWatchedDirectories(0)
+    , mInitScanSequence(0)
+    , mCurrentInitScan(0) {
+  mRoot = new InotifyNode(this, mInotifyInstance, nullptr, mRootPath,
+                          fs::path(""), false);
+
+  if (!mRoot->isAlive()) {
+    mCollector->sendError("录制文件中没有根目录快照");
+    delete mRoot;
+    mRoot = nullptr;
+  }
+}
+
+int InotifyTree::addWatch(const fs::path& relPath, const int mask) const {
+  if (mReplayer != nullptr) {
+    int error = 0;
+    const int wd = mReplayer->takeWatch(relPath, error);
+    errno = error;
+    return wd;
+  }
+
+  const auto fullPath = mRootPath / relPath;
+  int wd = inotify_add_watch(mInotifyInstance, fullPath.c_str(), mask);
+  int error = wd == -1 ? errno : 0;
+
+  if (wd != -1) {
+    std::error_code ec;
+    const auto status = fs::status(fullPath, ec);
+    if (ec || !is_directory(status) || is_symlink(status)) {
+      inotify_rm_watch(mInotifyInstance, wd);
+      /// 不是目录时静默跳过，ENOTDIR 不会触发任何错误上报
+      wd = -1;
+      error = ENOTDIR;
+    }
+  }
+
+  if (mRecorder != nullptr) {
+    mRecorder->recordWatch(relPath, wd, error);
+  }
+  errno = error;
+  return wd;
+}
+
+void InotifyTree::removeWatch(const int wd) const {
+  if (mReplayer != nullptr) { return; }
+  inotify_rm_watch(mInotifyInstance, wd);
+}
+
+bool InotifyTree::listDirectory(const fs::path& relPath, std::vector<DirEntry>& out) const {
+  if (mReplayer != nullptr) {
+    return mReplayer->takeListing(relPath, out);
+  }
+
+  if (mCrawler != nullptr) {
+    if (!mCrawler->listDirectory(mRootPath / relPath, out)) { return false; }
+  } else {
+    std::error_code ec;
+    auto dirItr = fs::directory_iterator(mRootPath / relPath, ec);
+    if (ec) { return false; }
+    for (auto& child : dirItr) {
+      /// 与 fs::status 一样跟随符号链接；非链接条目的 stat 结果同时就是它的身份
+      struct stat status{};
+      if (::stat(child.path().c_str(), &status) != 0) { continue; }
+      std::error_code linkEc;
+      const auto id = child.is_symlink(linkEc) || linkEc
+                        ? FileId{}
+                        : FileId{static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino)};
+      out.push_back({child.path().filename(), S_ISDIR(status.st_mode), id});
+    }
+  }
+
+  if (mRecorder != nullptr) {
+    mRecorder->recordListing(relPath, out);
+  }
+  return true;
+}
+
+void InotifyTree::finishCrawl(const bool threadDone) const {
+  if (mCrawler == nullptr) { return; }
+  if (threadDone) {
+    mCrawler->releaseRing();
+  } else {
+    mCrawler->finishCrawl();
+  }
+}
+
+void InotifyTree::pollSubtree(const fs::path& relPath, const bool sendInitEvents) const {
+  /// watch 耗尽后每个尚未监听的目录都会走到这里，只报告第一次
+  if (mPoller == nullptr || (!mEventPrefix.empty() && *mEventPrefix.begin() == "..")) {
+    if (!mSpaceExhausted.exchange(true)) {
+      mCollector->sendError("No space left on device： " + (mEventPrefix / relPath).string());
+    }
+    return;
+  }
+  /// 轮询扫描器以主根目录为基准，分片树的路径加上前缀即可
+  if (mPoller->addSubtree(mEventPrefix / relPath, sendInitEvents)) {
+    mCollector->sendError("inotify watch 已耗尽，改为轮询： " + (mEventPrefix / relPath).string());
+  }
+}
+
+bool InotifyTree::deferCrawl(const fs::path& relPath, const int wd, const bool sendInitEvents) {
+  std::lock_guard lock(mCrawlMutex);
+  ++mWatchedDirectories;
+  if (!mProgressive) { return false; }
+  const auto depth = static_cast<std::size_t>(std::distance(relPath.begin(), relPath.end()));
+  mCrawlQueue.push({crawlPriority(relPath), depth, mCrawlSequence++,
+                    wd, sendInitEvents, mCurrentInitScan});
+  if (mCurrentInitScan != 0) {
+    ++mInitScans.at(mCurrentInitScan).outstanding;
+  }
+  return true;
+}
+
+uint64_t InotifyTree::beginInitScan(const fs::path& subtree) {
+  std::lock_guard lock(mCrawlMutex);
+  const auto scanId = ++mInitScanSequence;
+  /// 初始计数 1 由发起方持有，同步遍历结束时释放
+  mInitScans.emplace(scanId, InitScan{subtree, 1});
+  return scanId;
+}
+
+void InotifyTree::finishInitScan(const uint64_t scanId) {
+  if (scanId == 0) { return; }
+  std::lock_guard lock(mCrawlMutex);
+  const auto itr = mInitScans.find(scanId);
+  if (itr == mInitScans.end() || --itr->second.outstanding != 0) { return; }
+  const auto& subtree = itr->second.subtree;
+  mCollector->completeInitScan(subtree.empty() ? mEventPrefix : mEventPrefix / subtree);
+  mInitScans.erase(itr);
+}
+
+int InotifyTree::crawlPriority(const fs::path& relPath) const {
+  /// 优先路径本身、其子孙以及通往它的祖先目录都算优先
+  for (const auto& priorityPath : mPriorityPaths) {
+    if (isInside(relPath, priorityPath) || isInside(priorityPath, relPath)) { return 0; }
+  }
+  return 1;
+}
+
+void InotifyTree::crawl() {
+  constexpr std::size_t REPORT_INTERVAL = 1024;
+  std::size_t sinceReport = 0;
+  while (!mStopCrawl) {
+    CrawlTask task{};
+    {
+      std::lock_guard lock(mCrawlMutex);
+      if (mCrawlQueue.empty()) {
+        /// 与 deferCrawl 在同一把锁下切换，之后新建的节点全部同步遍历
+        mProgressive = false;
+        break;
+      }
+      task = mCrawlQueue.top();
+      mCrawlQueue.pop();
+    }
+
+    fs::path relPath;
+    {
+      std::lock_guard treeLock(mTreeMutex);
+      const auto node = getInotifyTreeByWatchDescriptor(task.wd);
+      if (node == nullptr) {
+        finishInitScan(task.initScan);
+        continue;
+      }
+      relPath = node->getRelativePath();
+    }
+
+    /// 读目录不持锁，事件线程可以同时处理已监听目录的事件
+    std::vector<DirEntry> entries;
+    if (!listDirectory(relPath, entries)) {
+      finishInitScan(task.initScan);
+      continue;
+    }
+
+    {
+      std::lock_guard treeLock(mTreeMutex);
+      const auto node = getInotifyTreeByWatchDescriptor(task.wd);
+      if (node == nullptr) {
+        finishInitScan(task.initScan);
+        continue;
+      }
+      if (node->getRelativePath() != relPath) {
+        /// 遍历期间目录被移动，按新路径重新遍历
+        std::lock_guard lock(mCrawlMutex);
+        mCrawlQueue.push(task);
+        continue;
+      }
+      mCurrentInitScan = task.initScan;
+      node->addChildren(entries, task.sendInitEvents);
+      mCurrentInitScan = 0;
+    }
+    finishInitScan(task.initScan);
+
+    if (++sinceReport == REPORT_INTERVAL) {
+      sinceReport = 0;
+      reportProgress(false);
+    }
+  }
+  finishCrawl(true);
+  if (!mStopCrawl) { reportProgress(true); }
+}
+
+void InotifyTree::reportProgress(const bool ready) {
+  if (!mOnStartupProgress) { return; }
+  StartupProgress progress{};
+  {
+    std::lock_guard lock(mCrawlMutex);
+    progress = {mWatchedDirectories, mCrawlQueue.size(), ready};
+  }
+  mOnStartupProgress(progress);
+}
+
+bool InotifyTree::isReady() const {
+  std::lock_guard lock(mCrawlMutex);
+  return !mProgressive;
 }
 
 void InotifyTree::sendInitEvent(const fs::path& relPath) const {
-  mCollector->collect(CREATED, relPath);
+  mCollector->collectInit(mEventPrefix / relPath);
+}
+
+void InotifyTree::seedTail(const fs::path& relPath) const {
+  mCollector->seedTail(mEventPrefix / relPath);
+}
+
+void InotifyTree::seedIdentity(const fs::path& relPath, const FileId& id) const {
+  mCollector->seedIdentity(mEventPrefix / relPath, id);
 }
 
 InotifyNode::ptr InotifyTree::getInotifyTreeByWatchDescriptor(int watchDescriptor) {
@@ -39,11 +332,23 @@ InotifyNode::ptr InotifyTree::getInotifyTreeByWatchDescriptor(int watchDescripto
 void InotifyTree::addDirNode(const int wd,
                              const fs::path& name,
                              const bool sendInitEvents) {
+  std::lock_guard treeLock(mTreeMutex);
   InotifyNode::ptr const node = getInotifyTreeByWatchDescriptor(wd);
 
-  if (node != nullptr) {
-    node->addChild(name, sendInitEvents);
+  if (node == nullptr || isExcluded(node->getRelativePath() / name)) { return; }
+  if (!sendInitEvents) {
+    node->addChild(name, false);
+    finishCrawl(false);
+    return;
   }
+
+  /// 渐进式启动期间子树的遍历可能被推迟，结束标记要等所有推迟的遍历完成后才发出
+  const auto scanId = beginInitScan(node->getRelativePath() / name);
+  mCurrentInitScan = scanId;
+  node->addChild(name, true);
+  mCurrentInitScan = 0;
+  finishInitScan(scanId);
+  finishCrawl(false);
 }
 
 void InotifyTree::addNodeReferenceByWD(int wd, InotifyNode::ptr node) {
@@ -54,10 +359,18 @@ void InotifyTree::addNodeReferenceByWD(int wd, InotifyNode::ptr node) {
 bool InotifyTree::getRelPath(fs::path& out, int wd) {
   const InotifyNode::ptr node = getInotifyTreeByWatchDescriptor(wd);
   if (node == nullptr) { return false; }
-  out = node->getRelativePath();
+  out = mEventPrefix / node->getRelativePath();
   return true;
 }
 
+fs::path InotifyTree::getRoot() const { return mRootPath; }
+
+fs::path InotifyTree::getEventPrefix() const { return mEventPrefix; }
+
+bool InotifyTree::isRoot(const int wd) {
+  return mRoot != nullptr && getInotifyTreeByWatchDescriptor(wd) == mRoot;
+}
+
 bool InotifyTree::isRootAlive() const { return mRoot != nullptr; }
 
 bool InotifyTree::nodeExists(const int wd) {
@@ -66,6 +379,7 @@ bool InotifyTree::nodeExists(const int wd) {
 }
 
 void InotifyTree::removeDirNode(const int wd, const fs::path& name) {
+  std::lock_guard treeLock(mTreeMutex);
   InotifyNode::ptr const node = getInotifyTreeByWatchDescriptor(wd);
   if (node != nullptr) {
     node->removeChildNode(name);
@@ -73,6 +387,7 @@ void InotifyTree::removeDirNode(const int wd, const fs::path& name) {
 }
 
 void InotifyTree::removeDirNode(const int wd) {
+  std::lock_guard treeLock(mTreeMutex);
   InotifyNode::ptr const node = getInotifyTreeByWatchDescriptor(wd);
   if (node == nullptr) { return; }
 
@@ -96,10 +411,15 @@ void InotifyTree::removeNodeReferenceByWD(int wd) {
 
 void InotifyTree::moveDirNode(const int wdOld, const fs::path& oldName,
                               const int wdNew, const fs::path& newName) {
+  std::lock_guard treeLock(mTreeMutex);
   InotifyNode::ptr const node = getInotifyTreeByWatchDescriptor(wdOld);
   if (node == nullptr) {
     return addDirNode(wdNew, newName, true);
   }
+  /// 被排除的目录本身或其祖先改了名，排除项随之移动，旧路径上以后出现的目录照常监听
+  if (InotifyNode::ptr const target = getInotifyTreeByWatchDescriptor(wdNew)) {
+    moveExclusions(node->getRelativePath() / oldName, target->getRelativePath() / newName);
+  }
 
   InotifyNode::ptr const movingNode = node->removeAndGetChildNode(oldName);
 
@@ -108,20 +428,105 @@ void InotifyTree::moveDirNode(const int wdOld, const fs::path& oldName,
   }
 
   InotifyNode::ptr const nodeNew = getInotifyTreeByWatchDescriptor(wdNew);
-  if (nodeNew == nullptr) {
+  if (nodeNew == nullptr || isExcluded(nodeNew->getRelativePath() / newName)) {
     delete movingNode;
     return;
   }
+  /// 内核不允许把目录移进自己的子树；目标落在被移动的节点之下说明这部分树已与磁盘不符
+  /// （按路径 add_watch 时该路径已换成别的目录），放弃这棵子树，不能接出一个环
+  for (auto ancestor = nodeNew; ancestor != nullptr; ancestor = ancestor->getParentNode()) {
+    if (ancestor == movingNode) {
+      delete movingNode;
+      return;
+    }
+  }
 
   movingNode->setNewParentNode(newName, nodeNew);
   nodeNew->insertChildNode(movingNode);
 }
 
+bool InotifyTree::isStaleMove(const int wdOld, const fs::path& oldName, const fs::path& target) {
+  std::lock_guard treeLock(mTreeMutex);
+  InotifyNode::ptr const node = getInotifyTreeByWatchDescriptor(wdOld);
+  if (node == nullptr) { return false; }
+  InotifyNode::ptr const movingNode = node->getChildNode(oldName);
+  return movingNode != nullptr && !movingNode->watches(target.lexically_relative(mEventPrefix));
+}
+
+InotifyNode::ptr InotifyTree::findNode(const fs::path& relPath) const {
+  InotifyNode::ptr node = mRoot;
+  for (const auto& part : relPath) {
+    if (node == nullptr) { return nullptr; }
+    node = node->getChildNode(part);
+  }
+  return node;
+}
+
+void InotifyTree::moveExclusions(const fs::path& from, const fs::path& to) {
+  if (mExcluded.empty()) { return; }
+  std::vector<fs::path> moved;
+  for (auto itr = mExcluded.lower_bound(from); itr != mExcluded.end() && isInside(*itr, from);) {
+    const auto rest = itr->lexically_relative(from);
+    moved.push_back(rest == "." ? to : to / rest);
+    itr = mExcluded.erase(itr);
+  }
+  mExcluded.insert(moved.begin(), moved.end());
+}
+
+bool InotifyTree::isExcluded(const fs::path& relPath) {
+  if (mDelegateTopLevel && !relPath.empty() && relPath.parent_path().empty()) { return true; }
+  return isUnwatched(relPath);
+}
+
+bool InotifyTree::isUnwatched(const fs::path& relPath) {
+  std::lock_guard treeLock(mTreeMutex);
+  return !mExcluded.empty() && mExcluded.contains(relPath);
+}
+
+bool InotifyTree::unwatchSubtree(const fs::path& relPath) {
+  if (relPath.empty()) {
+    sendError("不能移除监听根目录");
+    return false;
+  }
+  {
+    std::lock_guard treeLock(mTreeMutex);
+    mExcluded.insert(relPath);
+    /// 节点析构时逐个 inotify_rm_watch，推迟中的遍历任务找不到 wd 会自动跳过
+    if (InotifyNode::ptr const parent = findNode(relPath.parent_path())) {
+      parent->removeChildNode(relPath.filename());
+    }
+  }
+  if (mPoller != nullptr) { mPoller->removeSubtree(mEventPrefix / relPath); }
+  return true;
+}
+
+bool InotifyTree::watchSubtree(const fs::path& relPath) {
+  std::lock_guard treeLock(mTreeMutex);
+  mExcluded.erase(relPath);
+  if (relPath.empty()) { return isRootAlive(); }
+  if (isExcluded(relPath)) { return true; }
+
+  InotifyNode::ptr const parent = findNode(relPath.parent_path());
+  if (parent == nullptr) {
+    sendError("父目录未被监听： " + relPath.string());
+    return false;
+  }
+  parent->addChild(relPath.filename(), false);
+  finishCrawl(true);
+  if (parent->getChildNode(relPath.filename()) == nullptr) {
+    sendError("无法监听： " + relPath.string());
+    return false;
+  }
+  return true;
+}
+
 void InotifyTree::sendError(const std::string& error) const {
   mCollector->sendError(error);
 }
 
 InotifyTree::~InotifyTree() {
+  mStopCrawl = true;
+  if (mCrawlThread.joinable()) { mCrawlThread.join(); }
   if (isRootAlive()) {
     delete mRoot;
   }
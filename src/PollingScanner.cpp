@@ -0,0 +1,223 @@
+#include "fw/PollingScanner.h"
+
+#include <ranges>
+#include <sys/stat.h>
+
+namespace {
+int64_t toNanoseconds(const timespec& time) {
+  return static_cast<int64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+}
+
+bool isInside(const fs::path& path, const fs::path& ancestor) {
+  if (ancestor.empty()) { return true; }
+  const auto& p = path.native();
+  const auto& a = ancestor.native();
+  return p.size() >= a.size() && p.compare(0, a.size(), a) == 0 &&
+    (p.size() == a.size() || p[a.size()] == '/');
+}
+}
+
+PollingScanner::PollingScanner(const fs::path& root,
+                               Collector::sptr collector,
+                               const std::chrono::milliseconds minInterval,
+                               const std::chrono::milliseconds maxInterval,
+                               const std::size_t budget)
+  : mRoot(root)
+    , mCollector(std::move(collector))
+    , mMinInterval(minInterval)
+    , mMaxInterval(std::max(minInterval, maxInterval))
+    , mBudget(std::max<std::size_t>(budget, 1))
+    , mRunning(false) {}
+
+bool PollingScanner::addSubtree(const fs::path& relPath, const bool sendInitEvents) {
+  {
+    std::lock_guard lock(mStateMutex);
+    trackDirectory(relPath, sendInitEvents, true, sendInitEvents ? std::optional(relPath) : std::nullopt);
+  }
+  const bool started = ensureRunning();
+  mWakeUp.notify_one();
+  return started;
+}
+
+void PollingScanner::removeSubtree(const fs::path& relPath) {
+  std::lock_guard lock(mStateMutex);
+  forgetDirectory(relPath, false);
+}
+
+bool PollingScanner::isPolling() const { return mRunning; }
+
+bool PollingScanner::ensureRunning() {
+  /// 只有真正有子树需要轮询时才启动线程，inotify 正常工作时不产生额外开销
+  bool expected = false;
+  if (!mRunning.compare_exchange_strong(expected, true)) { return false; }
+  mScanThread = std::thread(&PollingScanner::work, this);
+  return true;
+}
+
+void PollingScanner::work() {
+  std::unique_lock lock(mStateMutex);
+  while (mRunning) {
+    if (mSchedule.empty()) {
+      mWakeUp.wait(lock, [this] { return !mRunning || !mSchedule.empty(); });
+      continue;
+    }
+    if (const auto due = mSchedule.begin()->first; due > Clock::now()) {
+      mWakeUp.wait_until(lock, due);
+      continue;
+    }
+
+    std::size_t scanned = 0;
+    while (!mSchedule.empty() && scanned < mBudget &&
+      mSchedule.begin()->first <= Clock::now()) {
+      const auto relPath = mSchedule.begin()->second;
+      mSchedule.erase(mSchedule.begin());
+      if (auto itr = mDirectories.find(relPath); itr != mDirectories.end()) {
+        itr->second.scheduled = mSchedule.end();
+      }
+      scanDirectory(relPath);
+      ++scanned;
+    }
+
+    /// 预算用完说明还有积压，休眠一个最小间隔再继续，避免 stat 风暴
+    if (scanned == mBudget) {
+      mWakeUp.wait_for(lock, mMinInterval, [this] { return !mRunning; });
+    }
+  }
+}
+
+void PollingScanner::scanDirectory(const fs::path& relPath) {
+  const auto itr = mDirectories.find(relPath);
+  if (itr == mDirectories.end()) { return; }
+  DirState& state = itr->second;
+
+  const auto fullPath = mRoot / relPath;
+  struct stat dirStat{};
+  if (::stat(fullPath.c_str(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode)) {
+    /// 接管的子树根目录的父目录仍有 inotify watch，它自己的删除由父目录报告，这里只补报其内容
+    const bool reportSelf = state.isSubtreeRoot && relPath.empty();
+    forgetDirectory(relPath, true);
+    if (reportSelf) { mCollector->collect(DELETED, relPath); }
+    return;
+  }
+
+  const bool emit = state.scanned || state.sendInitEvents;
+  bool active = false;
+  const auto dirMtime = toNanoseconds(dirStat.st_mtim);
+
+  if (!state.scanned || dirMtime != state.mtimeNs) {
+    std::map<fs::path, EntryState> current;
+    std::error_code ec;
+    for (auto dirItr = fs::directory_iterator(fullPath, ec);
+         !ec && dirItr != fs::directory_iterator(); dirItr.increment(ec)) {
+      /// 与 inotify 遍历（fs::status）一致：跟随符号链接，悬空的链接跳过
+      struct stat entryStat{};
+      if (::stat(dirItr->path().c_str(), &entryStat) != 0) { continue; }
+      current[dirItr->path().filename()] = {
+        S_ISDIR(entryStat.st_mode), toNanoseconds(entryStat.st_mtim), entryStat.st_size
+      };
+    }
+
+    for (const auto& [name, entry] : state.entries) {
+      const auto found = current.find(name);
+      if (found != current.end() && found->second.isDirectory == entry.isDirectory) { continue; }
+      if (entry.isDirectory) { forgetDirectory(relPath / name, true); }
+      mCollector->collect(DELETED, relPath / name);
+      active = true;
+    }
+
+    for (const auto& [name, entry] : current) {
+      const auto previous = state.entries.find(name);
+      if (previous == state.entries.end() || previous->second.isDirectory != entry.isDirectory) {
+        if (state.scanned) {
+          mCollector->collect(CREATED, relPath / name);
+        } else if (emit) {
+          mCollector->collectInit(relPath / name);
+        }
+        if (entry.isDirectory) {
+          /// 首次扫描中发现的子目录属于同一次初始扫描，之后新出现的目录各自开始一次
+          const auto initScan = !emit ? std::nullopt : state.scanned ? std::optional(relPath / name) : state.initScan;
+          trackDirectory(relPath / name, emit, false, initScan);
+        }
+        active = active || state.scanned;
+      } else if (!entry.isDirectory && (previous->second.mtimeNs != entry.mtimeNs ||
+        previous->second.size != entry.size)) {
+        mCollector->collect(CHANGED, relPath / name);
+        active = true;
+      }
+    }
+
+    state.entries = std::move(current);
+    state.mtimeNs = dirMtime;
+  } else {
+    /// 目录 mtime 未变说明没有增删，只需检查已知文件的内容变化
+    for (auto& [name, entry] : state.entries) {
+      if (entry.isDirectory) { continue; }
+      struct stat entryStat{};
+      if (::stat((fullPath / name).c_str(), &entryStat) != 0) { continue; }
+      const auto mtime = toNanoseconds(entryStat.st_mtim);
+      if (mtime == entry.mtimeNs && entryStat.st_size == entry.size) { continue; }
+      entry.mtimeNs = mtime;
+      entry.size = entryStat.st_size;
+      mCollector->collect(CHANGED, relPath / name);
+      active = true;
+    }
+  }
+
+  state.scanned = true;
+  finishInitScan(state);
+  reschedule(state, relPath, active);
+}
+
+void PollingScanner::trackDirectory(const fs::path& relPath,
+                                    const bool sendInitEvents,
+                                    const bool isSubtreeRoot,
+                                    const std::optional<fs::path>& initScan) {
+  auto [itr, inserted] = mDirectories.try_emplace(relPath);
+  if (!inserted) { return; }
+  itr->second.sendInitEvents = sendInitEvents;
+  itr->second.isSubtreeRoot = isSubtreeRoot;
+  itr->second.initScan = initScan;
+  if (initScan) { ++mInitScans[*initScan]; }
+  itr->second.interval = mMinInterval;
+  itr->second.scheduled = mSchedule.emplace(Clock::now(), relPath);
+}
+
+void PollingScanner::forgetDirectory(const fs::path& relPath, const bool sendDeleted) {
+  auto itr = mDirectories.lower_bound(relPath);
+  while (itr != mDirectories.end() && isInside(itr->first, relPath)) {
+    if (sendDeleted) {
+      for (const auto& name : itr->second.entries | std::views::keys) {
+        mCollector->collect(DELETED, itr->first / name);
+      }
+    }
+    if (itr->second.scheduled != mSchedule.end()) {
+      mSchedule.erase(itr->second.scheduled);
+    }
+    /// 还没扫描到就消失的目录不再拖住所属的初始扫描
+    finishInitScan(itr->second);
+    itr = mDirectories.erase(itr);
+  }
+}
+
+void PollingScanner::finishInitScan(DirState& state) {
+  if (!state.initScan) { return; }
+  const auto itr = mInitScans.find(*state.initScan);
+  state.initScan.reset();
+  if (itr == mInitScans.end() || --itr->second != 0) { return; }
+  mCollector->completeInitScan(itr->first);
+  mInitScans.erase(itr);
+}
+
+void PollingScanner::reschedule(DirState& state, const fs::path& relPath, const bool active) {
+  state.interval = active ? mMinInterval : std::min(state.interval * 2, mMaxInterval);
+  state.scheduled = mSchedule.emplace(Clock::now() + state.interval, relPath);
+}
+
+PollingScanner::~PollingScanner() {
+  {
+    std::lock_guard lock(mStateMutex);
+    mRunning = false;
+  }
+  mWakeUp.notify_all();
+  if (mScanThread.joinable()) { mScanThread.join(); }
+}
@@ -0,0 +1,132 @@
+#include "fw/SubscriptionTrie.h"
+
+namespace {
+const auto SUBTREE_EVENTS = DELETED | RENAMED | REPLACED | SUBTREE_DIRTY | SCAN_COMPLETE;
+
+bool matches(const EventType mask, const EventType type) {
+  return (type & (mask | FAILED)) != NONE;
+}
+}
+
+SubscriptionTrie::SubscriptionTrie()
+  : mRoot(new Node{nullptr, {}, {}, {}}), mHandleCount(0) {}
+
+fs::path SubscriptionTrie::normalize(const fs::path& prefix) {
+  fs::path result;
+  for (const auto& part : prefix.lexically_normal()) {
+    if (part.empty() || part == "." || part == "/") { continue; }
+    result /= part;
+  }
+  return result;
+}
+
+SubscriptionTrie::Handle SubscriptionTrie::subscribe(const fs::path& prefix,
+                                                     const EventType mask,
+                                                     const Callback& callback) {
+  std::lock_guard lock(mSubscriptionMutex);
+  Node* node = mRoot;
+  for (const auto& part : normalize(prefix)) {
+    auto [itr, inserted] = node->children.try_emplace(part, nullptr);
+    if (inserted) { itr->second = new Node{node, part, {}, {}}; }
+    node = itr->second;
+  }
+
+  auto* subscription = new Subscription{++mHandleCount, mask, std::make_shared<const Callback>(callback), node, {}};
+  node->subscriptions.push_back(subscription);
+  mSubscriptions.emplace(subscription->handle, subscription);
+  return subscription->handle;
+}
+
+void SubscriptionTrie::unsubscribe(const Handle handle) {
+  std::lock_guard lock(mSubscriptionMutex);
+  const auto itr = mSubscriptions.find(handle);
+  if (itr == mSubscriptions.end()) { return; }
+  auto* subscription = itr->second;
+  mSubscriptions.erase(itr);
+  std::erase(subscription->node->subscriptions, subscription);
+  prune(subscription->node);
+  delete subscription;
+}
+
+bool SubscriptionTrie::empty() {
+  std::lock_guard lock(mSubscriptionMutex);
+  return mSubscriptions.empty();
+}
+
+void SubscriptionTrie::prune(Node* node) {
+  /// 没有订阅也没有子节点的分支逐级删除
+  while (node != mRoot && node->subscriptions.empty() && node->children.empty()) {
+    Node* parent = node->parent;
+    parent->children.erase(node->name);
+    delete node;
+    node = parent;
+  }
+}
+
+void SubscriptionTrie::collect(Node* node, const Event& event, std::vector<Subscription*>& touched) {
+  for (auto* subscription : node->subscriptions) {
+    if (!matches(subscription->mask, event.type)) { continue; }
+    if (subscription->batch.empty()) { touched.push_back(subscription); }
+    subscription->batch.push_back(std::make_unique<Event>(event));
+  }
+}
+
+void SubscriptionTrie::collectSubtree(Node* node, const Event& event, std::vector<Subscription*>& touched) {
+  for (const auto& [name, child] : node->children) {
+    collect(child, event, touched);
+    collectSubtree(child, event, touched);
+  }
+}
+
+void SubscriptionTrie::route(const std::vector<Event::uptr>& events) {
+  std::unique_lock lock(mSubscriptionMutex);
+  if (mSubscriptions.empty()) { return; }
+
+  std::vector<Subscription*> touched;
+  for (const auto& event : events) {
+    if (event->type & (OVERFLOW | FAILED)) {
+      collect(mRoot, *event, touched);
+      collectSubtree(mRoot, *event, touched);
+      continue;
+    }
+
+    Node* node = mRoot;
+    collect(node, *event, touched);
+    bool complete = true;
+    for (const auto& part : event->relativePath) {
+      const auto child = node->children.find(part);
+      if (child == node->children.end()) {
+        complete = false;
+        break;
+      }
+      node = child->second;
+      collect(node, *event, touched);
+    }
+    if (complete && (event->type & SUBTREE_EVENTS) != NONE) {
+      collectSubtree(node, *event, touched);
+    }
+  }
+
+  std::vector<std::pair<std::shared_ptr<const Callback>, std::vector<Event::uptr>>> deliveries;
+  deliveries.reserve(touched.size());
+  for (auto* subscription : touched) {
+    deliveries.emplace_back(subscription->callback, std::move(subscription->batch));
+    subscription->batch.clear();
+  }
+  lock.unlock();
+
+  /// 回调可能重新进入 subscribe/unsubscribe（或释放 WatchRegistry 的租约），不能持锁调用
+  for (auto& [callback, batch] : deliveries) {
+    (*callback)(std::move(batch));
+  }
+}
+
+void SubscriptionTrie::destroy(Node* node) {
+  for (const auto& [name, child] : node->children) { destroy(child); }
+  delete node;
+}
+
+SubscriptionTrie::~SubscriptionTrie() {
+  for (const auto& [handle, subscription] : mSubscriptions) { delete subscription; }
+  destroy(mRoot);
+}
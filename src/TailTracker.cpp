@@ -0,0 +1,85 @@
+#include "fw/TailTracker.h"
+
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+TailTracker::TailTracker() : mEnabled(false) {}
+
+void TailTracker::configure(const fs::path& root, const std::vector<std::string>& patterns) {
+  std::lock_guard lock(mTailMutex);
+  mRoot = root;
+  mPatterns = patterns;
+  mEnabled = !mPatterns.empty();
+}
+
+bool TailTracker::isEnabled() const { return mEnabled; }
+
+bool TailTracker::matches(const fs::path& relPath) const {
+  for (const auto& pattern : mPatterns) {
+    if (fnmatch(pattern.c_str(), relPath.c_str(), 0) == 0) { return true; }
+  }
+  return false;
+}
+
+bool TailTracker::stat(const fs::path& relPath, FileId& key, uint64_t& size) const {
+  struct stat status{};
+  if (::stat((mRoot / relPath).c_str(), &status) != 0 || !S_ISREG(status.st_mode)) { return false; }
+  key = {status.st_dev, status.st_ino};
+  size = static_cast<uint64_t>(status.st_size);
+  return true;
+}
+
+void TailTracker::seed(const fs::path& relPath) {
+  if (!mEnabled) { return; }
+  std::lock_guard lock(mTailMutex);
+  FileId key{};
+  uint64_t size = 0;
+  if (!matches(relPath) || !stat(relPath, key, size)) { return; }
+  mSizes[key] = size;
+  mKeys[relPath] = key;
+}
+
+void TailTracker::annotate(std::vector<Event::uptr>& events) {
+  std::lock_guard lock(mTailMutex);
+  for (const auto& event : events) {
+    if ((event->type & (CREATED | CHANGED | DELETED)) == NONE) { continue; }
+    if (!matches(event->relativePath)) { continue; }
+    annotateEvent(*event);
+  }
+}
+
+void TailTracker::annotateEvent(Event& event) {
+  const auto& path = event.relativePath;
+  const auto known = mKeys.find(path);
+
+  if (deleted(event.type)) {
+    if (known == mKeys.end()) { return; }
+    /// 改名移走时保留路径记录，之后同名新文件出现即为轮转；inode 状态随 CREATED|RENAMED 转到新路径
+    if (!renamed(event.type)) {
+      mSizes.erase(known->second);
+      mKeys.erase(known);
+    }
+    return;
+  }
+
+  FileId key{};
+  uint64_t size = 0;
+  if (!stat(path, key, size)) { return; }
+
+  auto type = event.type;
+  if (known != mKeys.end() && known->second != key) {
+    type = type | ROTATED;
+  }
+
+  uint64_t last = 0;
+  if (const auto itr = mSizes.find(key); itr != mSizes.end()) { last = itr->second; }
+  if (size < last) {
+    type = type | TRUNCATED;
+    last = 0;
+  }
+
+  event.type = type;
+  event.appended = ByteRange{last, size - last};
+  mSizes[key] = size;
+  mKeys[path] = key;
+}
@@ -0,0 +1,353 @@
+#include "fw/UringCrawler.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <ranges>
+
+namespace {
+constexpr uint64_t PREFETCH_TAG = 1ull << 63;
+
+int ioUringSetup(const unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringRegister(const int fd, const unsigned opcode, void* arg, const unsigned count) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+int ioUringEnter(const int fd, const unsigned toSubmit, const unsigned minComplete, const unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* offsetOf(void* base, const unsigned offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+struct RawEntry {
+  std::string name;
+  unsigned char type;
+  ino64_t inode;
+};
+}
+
+UringCrawler::UringCrawler(const unsigned queueDepth)
+  : mQueueDepth(queueDepth), mAvailable(false) {
+  /// 构造线程通常就是执行同步初始遍历的线程，它的 ring 顺带用来判断可用性
+  const auto first = new Ring(queueDepth);
+  mAvailable = first->isAvailable();
+  if (!mAvailable) {
+    delete first;
+    return;
+  }
+  mRings.emplace(std::this_thread::get_id(), first);
+}
+
+bool UringCrawler::isAvailable() const { return mAvailable; }
+
+UringCrawler::Ring::ptr UringCrawler::ring() {
+  std::lock_guard lock(mRingsMutex);
+  auto& slot = mRings[std::this_thread::get_id()];
+  if (slot == nullptr) { slot = new Ring(mQueueDepth); }
+  return slot->isAvailable() ? slot : nullptr;
+}
+
+bool UringCrawler::listDirectory(const fs::path& fullPath, std::vector<DirEntry>& out) {
+  if (const auto current = ring()) { return current->listDirectory(fullPath, out); }
+  /// 该线程的 ring 建立失败（如 memlock 限额），退回与同步遍历相同的列举方式
+  std::error_code ec;
+  auto dirItr = fs::directory_iterator(fullPath, ec);
+  if (ec) { return false; }
+  for (auto& child : dirItr) {
+    struct stat status{};
+    if (::stat(child.path().c_str(), &status) != 0) { continue; }
+    std::error_code linkEc;
+    const auto id = child.is_symlink(linkEc) || linkEc
+                      ? FileId{}
+                      : FileId{static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino)};
+    out.push_back({child.path().filename(), S_ISDIR(status.st_mode), id});
+  }
+  return true;
+}
+
+void UringCrawler::finishCrawl() {
+  std::lock_guard lock(mRingsMutex);
+  if (const auto itr = mRings.find(std::this_thread::get_id()); itr != mRings.end()) {
+    itr->second->discardPrefetches();
+  }
+}
+
+void UringCrawler::releaseRing() {
+  Ring::ptr released = nullptr;
+  {
+    std::lock_guard lock(mRingsMutex);
+    if (const auto itr = mRings.find(std::this_thread::get_id()); itr != mRings.end()) {
+      released = itr->second;
+      mRings.erase(itr);
+    }
+  }
+  delete released;
+}
+
+UringCrawler::~UringCrawler() {
+  for (const auto* ring : mRings | std::views::values) { delete ring; }
+}
+
+UringCrawler::Ring::Ring(const unsigned queueDepth)
+  : mRingFd(-1), mEntries(0), mInflight(0)
+    , mSqRing(MAP_FAILED), mCqRing(MAP_FAILED), mSqRingSize(0), mCqRingSize(0)
+    , mSqes(nullptr), mSqesSize(0)
+    , mSqHead(nullptr), mSqTail(nullptr), mSqMask(nullptr), mSqArray(nullptr)
+    , mCqHead(nullptr), mCqTail(nullptr), mCqMask(nullptr), mCqes(nullptr)
+    , mStatxRemaining(0), mPendingBase(0), mOpenFds(0) {
+  io_uring_params params{};
+  mRingFd = ioUringSetup(queueDepth, &params);
+  if (mRingFd < 0) {
+    mRingFd = -1;
+    return;
+  }
+  mEntries = params.sq_entries;
+
+  mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+  }
+
+  mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 mRingFd, IORING_OFF_SQ_RING);
+  mCqRing = singleMmap
+              ? mSqRing
+              : mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     mRingFd, IORING_OFF_CQ_RING);
+  mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    mRingFd, IORING_OFF_SQES);
+  mSqes = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+  if (mSqRing == MAP_FAILED || mCqRing == MAP_FAILED || mSqes == nullptr || !probe()) {
+    release();
+    return;
+  }
+
+  mSqHead = offsetOf<unsigned>(mSqRing, params.sq_off.head);
+  mSqTail = offsetOf<unsigned>(mSqRing, params.sq_off.tail);
+  mSqMask = offsetOf<unsigned>(mSqRing, params.sq_off.ring_mask);
+  mSqArray = offsetOf<unsigned>(mSqRing, params.sq_off.array);
+  mCqHead = offsetOf<unsigned>(mCqRing, params.cq_off.head);
+  mCqTail = offsetOf<unsigned>(mCqRing, params.cq_off.tail);
+  mCqMask = offsetOf<unsigned>(mCqRing, params.cq_off.ring_mask);
+  mCqes = offsetOf<io_uring_cqe>(mCqRing, params.cq_off.cqes);
+}
+
+bool UringCrawler::Ring::isAvailable() const { return mRingFd != -1; }
+
+bool UringCrawler::Ring::probe() const {
+  /// 5.6 之前的内核没有 PROBE，也没有 OPENAT/STATX；只探测 io_uring_setup 会让每个 statx 都返回 -EINVAL
+  constexpr unsigned count = IORING_OP_STATX + 1;
+  std::vector<char> storage(sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op), 0);
+  auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+  if (ioUringRegister(mRingFd, IORING_REGISTER_PROBE, probe, count) < 0) { return false; }
+  const auto supported = [probe](const unsigned op) {
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  };
+  return supported(IORING_OP_OPENAT) && supported(IORING_OP_STATX);
+}
+
+void UringCrawler::Ring::release() {
+  if (mSqes != nullptr) { munmap(mSqes, mSqesSize); }
+  if (mCqRing != MAP_FAILED && mCqRing != mSqRing) { munmap(mCqRing, mCqRingSize); }
+  if (mSqRing != MAP_FAILED) { munmap(mSqRing, mSqRingSize); }
+  mSqes = nullptr;
+  mSqRing = mCqRing = MAP_FAILED;
+  if (mRingFd != -1) { close(mRingFd); }
+  mRingFd = -1;
+}
+
+io_uring_sqe* UringCrawler::Ring::nextSqe() {
+  const unsigned tail = *mSqTail;
+  const unsigned index = tail & *mSqMask;
+  auto* sqe = &mSqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  mSqArray[index] = index;
+  __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+  ++mInflight;
+  return sqe;
+}
+
+void UringCrawler::Ring::submit(const unsigned count, const unsigned waitFor) {
+  if (count == 0 && waitFor == 0) { return; }
+  int result;
+  do {
+    result = ioUringEnter(mRingFd, count, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+  } while (result < 0 && errno == EINTR);
+  reapCompletions();
+}
+
+void UringCrawler::Ring::reapCompletions() {
+  unsigned head = *mCqHead;
+  while (head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE)) {
+    const auto& cqe = mCqes[head & *mCqMask];
+    if (cqe.user_data & PREFETCH_TAG) {
+      auto& pending = mPendingOpens[(cqe.user_data & ~PREFETCH_TAG) - mPendingBase];
+      pending.completed = true;
+      pending.fd = cqe.res >= 0 ? cqe.res : -1;
+    } else {
+      mStatxResults[cqe.user_data] = cqe.res;
+      --mStatxRemaining;
+    }
+    --mInflight;
+    ++head;
+  }
+  __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+}
+
+int UringCrawler::Ring::takeDirectoryFd(const std::string& path) {
+  const auto itr = mPendingByPath.find(path);
+  if (itr == mPendingByPath.end()) { return -1; }
+  auto& pending = mPendingOpens[itr->second - mPendingBase];
+  mPendingByPath.erase(itr);
+  while (!pending.completed) { submit(0, 1); }
+  pending.consumed = true;
+  --mOpenFds;
+  return pending.fd;
+}
+
+void UringCrawler::Ring::prefetchOpen(const std::string& path) {
+  /// 预取的 fd 按提交顺序排队；超过上限时关闭最早的、迟迟未被用到的 fd
+  const unsigned maxOpenFds = mEntries / 2;
+  while (!mPendingOpens.empty() && mPendingOpens.front().completed &&
+    (mPendingOpens.front().consumed || mOpenFds >= maxOpenFds)) {
+    auto& front = mPendingOpens.front();
+    if (!front.consumed) {
+      if (front.fd != -1) { close(front.fd); }
+      mPendingByPath.erase(front.path);
+      --mOpenFds;
+    }
+    mPendingOpens.pop_front();
+    ++mPendingBase;
+  }
+  if (mOpenFds >= maxOpenFds || mInflight >= mEntries || mPendingByPath.contains(path)) {
+    return;
+  }
+
+  const uint64_t sequence = mPendingBase + mPendingOpens.size();
+  auto& pending = mPendingOpens.emplace_back();
+  pending.path = path;
+  mPendingByPath[path] = sequence;
+  ++mOpenFds;
+
+  auto* sqe = nextSqe();
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64_t>(pending.path.c_str());
+  sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  sqe->user_data = PREFETCH_TAG | sequence;
+}
+
+bool UringCrawler::Ring::listDirectory(const fs::path& fullPath, std::vector<DirEntry>& out) {
+  reapCompletions();
+
+  const auto& path = fullPath.native();
+  int dirFd = takeDirectoryFd(path);
+  if (dirFd == -1) {
+    dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+  if (dirFd == -1) { return false; }
+
+  std::vector<RawEntry> rawEntries;
+  alignas(dirent64) char buffer[32768];
+  ssize_t bytesRead;
+  while ((bytesRead = getdents64(dirFd, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t position = 0; position < bytesRead;) {
+      const auto* entry = reinterpret_cast<const dirent64*>(buffer + position);
+      position += entry->d_reclen;
+      if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) { continue; }
+      rawEntries.push_back({entry->d_name, entry->d_type, entry->d_ino});
+    }
+  }
+  /// 条目的身份取 d_ino 与所在目录的设备号，不必逐个 stat；挂载点得到的是被覆盖目录的 inode
+  struct stat directoryStat{};
+  if (bytesRead < 0 || fstat(dirFd, &directoryStat) != 0) {
+    close(dirFd);
+    return false;
+  }
+
+  /// d_type 无法确定类型的条目（符号链接需要跟随，与 fs::status 一致）批量 statx
+  std::vector<std::size_t> needStat;
+  for (std::size_t i = 0; i < rawEntries.size(); ++i) {
+    if (rawEntries[i].type == DT_LNK || rawEntries[i].type == DT_UNKNOWN) {
+      needStat.push_back(i);
+    }
+  }
+  std::vector<struct statx> statBuffers(needStat.size());
+  mStatxResults.assign(needStat.size(), 0);
+  mStatxRemaining = needStat.size();
+  std::size_t next = 0;
+  while (mStatxRemaining > 0) {
+    unsigned queued = 0;
+    for (; next < needStat.size() && mInflight < mEntries; ++next, ++queued) {
+      auto* sqe = nextSqe();
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = dirFd;
+      sqe->addr = reinterpret_cast<uint64_t>(rawEntries[needStat[next]].name.c_str());
+      sqe->len = STATX_TYPE;
+      sqe->off = reinterpret_cast<uint64_t>(&statBuffers[next]);
+      sqe->statx_flags = 0;
+      sqe->user_data = next;
+    }
+    submit(queued, 1);
+  }
+  for (std::size_t i = 0; i < needStat.size(); ++i) {
+    auto& entry = rawEntries[needStat[i]];
+    if (mStatxResults[i] >= 0) {
+      entry.type = S_ISDIR(statBuffers[i].stx_mode) ? DT_DIR : DT_REG;
+      continue;
+    }
+    /// 失败的 statx 同步复核一次；悬空链接等仍然失败的条目与同步遍历一样直接跳过
+    struct stat entryStat{};
+    entry.type = fstatat(dirFd, entry.name.c_str(), &entryStat, 0) != 0
+                   ? DT_UNKNOWN
+                   : S_ISDIR(entryStat.st_mode) ? DT_DIR : DT_REG;
+  }
+  close(dirFd);
+
+  unsigned queued = 0;
+  for (auto& [name, type, inode] : rawEntries) {
+    if (type == DT_UNKNOWN) { continue; }
+    const bool isDirectory = type == DT_DIR;
+    if (isDirectory) {
+      const auto before = mInflight;
+      prefetchOpen((fullPath / name).native());
+      queued += mInflight - before;
+    }
+    out.push_back({std::move(name), isDirectory,
+                   FileId{static_cast<uint64_t>(directoryStat.st_dev), static_cast<uint64_t>(inode)}});
+  }
+  submit(queued, 0);
+  return true;
+}
+
+void UringCrawler::Ring::discardPrefetches() {
+  if (mRingFd == -1) { return; }
+  while (mInflight > 0) { submit(0, 1); }
+  for (const auto& pending : mPendingOpens) {
+    if (!pending.consumed && pending.fd != -1) { close(pending.fd); }
+  }
+  mPendingBase += mPendingOpens.size();
+  mPendingOpens.clear();
+  mPendingByPath.clear();
+  mOpenFds = 0;
+}
+
+UringCrawler::Ring::~Ring() {
+  if (mRingFd == -1) { return; }
+  discardPrefetches();
+  release();
+}
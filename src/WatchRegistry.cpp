@@ -0,0 +1,243 @@
+#include "fw/WatchRegistry.h"
+#include "fw/InotifyService.h"
+
+#include <algorithm>
+#include <ranges>
+#include <set>
+
+namespace {
+/// 当前线程正在执行的注册表事件回调层数
+thread_local int tDelivering = 0;
+
+bool isWithin(const fs::path& path, const fs::path& root) {
+  return std::mismatch(root.begin(), root.end(), path.begin(), path.end()).first == root.end();
+}
+
+/// 把共享树的相对路径改写为相对 prefix；prefix 本身及其祖先上的事件（删除、重命名、子树变脏）
+/// 对使用者来说都作用在它的根目录上
+fs::path project(const fs::path& relativePath, const fs::path& prefix) {
+  if (prefix.empty()) { return relativePath; }
+  if (!isWithin(relativePath, prefix)) { return {}; }
+  const auto relative = relativePath.lexically_relative(prefix);
+  return relative == "." ? fs::path() : relative;
+}
+
+/// 录制、日志、审计与回调属于创建者，别的使用者共享这样的树会收到或触发不属于自己的副作用
+bool isShareable(const WatchOptions& options) {
+  return options.recordingFile.empty() && options.journalDirectory.empty() &&
+    options.auditInterval.count() == 0 && !options.onAudit && !options.onStartupProgress;
+}
+
+/// 决定事件内容与节奏的选项；遍历方式、优先路径、分片等只影响启动过程
+bool deliversAlike(const WatchOptions& lhs, const WatchOptions& rhs) {
+  return lhs.backend == rhs.backend && lhs.coalesceEvents == rhs.coalesceEvents &&
+    lhs.fileIdentity == rhs.fileIdentity && lhs.tailPatterns == rhs.tailPatterns &&
+    lhs.aggregationThreshold == rhs.aggregationThreshold && lhs.aggregationWindow == rhs.aggregationWindow &&
+    lhs.initEventChunkSize == rhs.initEventChunkSize &&
+    lhs.pollMinInterval == rhs.pollMinInterval && lhs.pollMaxInterval == rhs.pollMaxInterval &&
+    lhs.pollBudget == rhs.pollBudget;
+}
+}
+
+WatchRegistry& WatchRegistry::instance() {
+  static WatchRegistry registry;
+  return registry;
+}
+
+WatchRegistry::WatchRegistry() : mHandleCount(0), mStopping(false) {}
+
+WatchRegistry::SharedTree* WatchRegistry::findCovering(const fs::path& path,
+                                                       const std::chrono::milliseconds latency,
+                                                       const WatchOptions& options) const {
+  if (!isShareable(options)) { return nullptr; }
+  for (const auto& [root, tree] : mTrees) {
+    /// map 按路径分量排序，祖先在前，第一个命中的就是最大的
+    if (isWithin(path, root) && tree->latency == latency && isShareable(tree->options) &&
+      deliversAlike(tree->options, options)) {
+      return tree;
+    }
+  }
+  return nullptr;
+}
+
+SubscriptionTrie::Handle WatchRegistry::subscribe(const SharedTree* tree,
+                                                  const Filter::sptr& filter,
+                                                  const fs::path& root) {
+  auto prefix = root.lexically_relative(tree->root);
+  if (prefix == ".") { prefix.clear(); }
+  return tree->backend->subscribe(
+    prefix, [filter, prefix](std::vector<Event::uptr>&& events) {
+      for (auto& event : events) {
+        if (failed(event->type)) { continue; }
+        event->relativePath = project(event->relativePath, prefix);
+      }
+      ++tDelivering;
+      filter->filterAndNotify(std::move(events));
+      --tDelivering;
+    });
+}
+
+WatchRegistry::Handle WatchRegistry::acquire(const Filter::sptr& filter,
+                                             const fs::path& path,
+                                             const std::chrono::milliseconds latency,
+                                             const WatchOptions& options) {
+  if (options.threadless) {
+    filter->sendError("共享监听不支持无线程模式： " + path.string());
+    return 0;
+  }
+  std::error_code error;
+  auto root = fs::weakly_canonical(path, error);
+  if (error) { root = path.lexically_normal(); }
+
+  std::unique_lock lock(mRegistryMutex);
+  SharedTree* tree = findCovering(root, latency, options);
+  /// 覆盖它的树还在遍历：等它就绪，失败的树会被摘下，届时重新查找
+  while (tree != nullptr && !tree->ready) {
+    mTreeReady.wait(lock);
+    tree = findCovering(root, latency, options);
+  }
+  const bool created = tree == nullptr;
+  if (created) {
+    tree = new SharedTree{root, latency, options, std::make_shared<Filter>(), nullptr, 0, false};
+    mTrees.emplace(root, tree);
+  }
+
+  /// 先订阅再启动，构造过程中的错误也能送达
+  ++tree->references;
+  const auto handle = ++mHandleCount;
+  mLeases.emplace(handle, Lease{tree, subscribe(tree, filter, root), filter, root});
+  if (!created) { return handle; }
+
+  /// 遍历整棵树可能很久，期间不占用注册表
+  lock.unlock();
+  auto* service = new InotifyService(tree->backend, root, latency, options);
+  lock.lock();
+  tree->service = service;
+  tree->ready = true;
+  if (!service->isWatching()) {
+    eraseTree(tree);
+  }
+  const auto retired = consolidate();
+  mTreeReady.notify_all();
+  lock.unlock();
+
+  dispose(retired);
+  return handle;
+}
+
+std::vector<WatchRegistry::SharedTree*> WatchRegistry::consolidate() {
+  std::vector<SharedTree*> retired;
+  for (auto itr = mTrees.begin(); itr != mTrees.end();) {
+    SharedTree* tree = itr->second;
+    SharedTree* covering = findCovering(tree->root, tree->latency, tree->options);
+    if (covering == nullptr || covering == tree || !tree->ready || !covering->ready) {
+      ++itr;
+      continue;
+    }
+    /// 先在新树上订阅再退订旧树，宁可重复也不丢
+    for (auto& lease : mLeases | std::views::values) {
+      if (lease.tree != tree) { continue; }
+      const auto previous = lease.subscription;
+      lease.subscription = subscribe(covering, lease.filter, lease.root);
+      lease.tree = covering;
+      ++covering->references;
+      tree->backend->unsubscribe(previous);
+    }
+    itr = mTrees.erase(itr);
+    retired.push_back(tree);
+  }
+  return retired;
+}
+
+void WatchRegistry::release(const Handle handle) {
+  SharedTree* released = nullptr;
+  {
+    std::lock_guard lock(mRegistryMutex);
+    const auto itr = mLeases.find(handle);
+    if (itr == mLeases.end()) { return; }
+    const auto [tree, subscription, filter, root] = itr->second;
+    mLeases.erase(itr);
+    tree->backend->unsubscribe(subscription);
+    if (--tree->references == 0) {
+      /// 失败的树已经不在表中，同名路径上可能是后来新建的另一棵
+      eraseTree(tree);
+      released = tree;
+    }
+  }
+
+  /// 析构会等待 Collector 线程退出，放在锁外
+  if (released != nullptr) { dispose({released}); }
+}
+
+void WatchRegistry::dispose(const std::vector<SharedTree*>& trees) {
+  if (trees.empty()) { return; }
+  if (tDelivering == 0) {
+    for (const auto* tree : trees) {
+      delete tree->service;
+      delete tree;
+    }
+    return;
+  }
+  /// 在回调中析构会让 Collector 线程 join 自己
+  std::lock_guard lock(mReaperMutex);
+  mGraveyard.insert(mGraveyard.end(), trees.begin(), trees.end());
+  if (!mReaper.joinable()) { mReaper = std::thread(&WatchRegistry::reap, this); }
+  mReaperWake.notify_one();
+}
+
+void WatchRegistry::reap() {
+  std::unique_lock lock(mReaperMutex);
+  while (true) {
+    mReaperWake.wait(lock, [this] { return mStopping || !mGraveyard.empty(); });
+    if (mGraveyard.empty()) { return; }
+    const auto* tree = mGraveyard.front();
+    mGraveyard.pop_front();
+    lock.unlock();
+    delete tree->service;
+    delete tree;
+    lock.lock();
+  }
+}
+
+void WatchRegistry::eraseTree(const SharedTree* tree) {
+  const auto [first, last] = mTrees.equal_range(tree->root);
+  for (auto itr = first; itr != last; ++itr) {
+    if (itr->second == tree) {
+      mTrees.erase(itr);
+      return;
+    }
+  }
+}
+
+std::size_t WatchRegistry::sharedTrees() {
+  std::lock_guard lock(mRegistryMutex);
+  return mTrees.size();
+}
+
+WatchRegistry::~WatchRegistry() {
+  {
+    std::lock_guard lock(mReaperMutex);
+    mStopping = true;
+  }
+  mReaperWake.notify_one();
+  if (mReaper.joinable()) { mReaper.join(); }
+
+  /// 失败后摘下的树只挂在租约上
+  std::set<SharedTree*> trees;
+  for (auto* tree : mTrees | std::views::values) { trees.insert(tree); }
+  for (const auto& lease : mLeases | std::views::values) { trees.insert(lease.tree); }
+  for (const auto* tree : trees) {
+    delete tree->service;
+    delete tree;
+  }
+}
+
+SharedWatch::SharedWatch(const Filter::sptr& filter,
+                         const fs::path& path,
+                         const std::chrono::milliseconds latency,
+                         const WatchOptions& options)
+  : mHandle(WatchRegistry::instance().acquire(filter, path, latency, options)) {}
+
+SharedWatch::~SharedWatch() {
+  WatchRegistry::instance().release(mHandle);
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "fw/EventJournal.h"
+
+/// 事件日志合并的回归检查，失败时返回非零。
+/// 用法： fw_journal_test [临时目录]
+namespace {
+int failures = 0;
+
+void expect(const bool condition, const std::string& message) {
+  if (condition) { return; }
+  std::cerr << "失败： " << message << std::endl;
+  ++failures;
+}
+
+void add(std::vector<Event::uptr>& batch, const EventType type, const fs::path& path) {
+  batch.push_back(std::make_unique<Event>(type, path));
+}
+
+/// 用同一路径的 CHANGED 填满活动段，使其封存
+void fill(std::vector<Event::uptr>& batch) {
+  for (int i = 0; i < 64; ++i) { add(batch, CHANGED, "filler"); }
+}
+
+/// 依次写入两批事件，每批都会封存一个段，第二次封存时触发合并；返回合并后读到的全部事件
+std::vector<Event::uptr> compacted(const fs::path& directory,
+                                   std::vector<Event::uptr> first,
+                                   std::vector<Event::uptr> second) {
+  fs::remove_all(directory);
+  {
+    EventJournal journal(directory, 4096, 2, false);
+    expect(journal.isOpen(), "无法打开日志： " + directory.string());
+    EventJournal rival(directory, 4096, 2, false);
+    expect(!rival.isOpen(), "同一目录的第二个写入者不应打开成功");
+    fill(first);
+    fill(second);
+    journal.append(first);
+    journal.append(second);
+  }
+  std::vector<Event::uptr> events;
+  JournalReader(directory).read(0, events);
+  std::size_t fillers = 0;
+  for (const auto& event : events) { fillers += event->relativePath == "filler"; }
+  expect(fillers == 1, "封存段没有被合并");
+  return events;
+}
+
+std::string describe(const std::vector<Event::uptr>& events) {
+  std::string result;
+  for (const auto& event : events) {
+    if (event->relativePath == "filler") { continue; }
+    result += std::to_string(event->sequence) + " " + translate(event->type) + " " + event->relativePath.string() + "; ";
+  }
+  return result;
+}
+
+/// rm -rf d && mkdir d：删除 d 的墓碑不能被之后的 CREATED 覆盖，否则消费者以为 d/x 还在
+void removeAndRecreate(const fs::path& directory) {
+  std::vector<Event::uptr> first, second;
+  add(first, DELETED, "d/x");
+  add(first, DELETED, "d");
+  add(first, CREATED, "d");
+  const auto events = compacted(directory, std::move(first), std::move(second));
+
+  const Event* tombstone = nullptr;
+  const Event* recreated = nullptr;
+  for (const auto& event : events) {
+    expect(event->relativePath != "d/x", "d/x 应被 d 的墓碑取代： " + describe(events));
+    if (event->relativePath != "d") { continue; }
+    (deleted(event->type) ? tombstone : recreated) = event.get();
+  }
+  expect(tombstone != nullptr && recreated != nullptr && created(recreated->type) &&
+         tombstone->sequence < recreated->sequence,
+         "应先删除 d 再创建 d： " + describe(events));
+}
+
+/// 改名移入的一半之后又被修改，改名对仍须完整保留，否则移走的子树成了单纯的删除
+void renameThenChange(const fs::path& directory) {
+  std::vector<Event::uptr> first, second;
+  add(first, DELETED | RENAMED, "a");
+  add(first, CREATED | RENAMED, "b");
+  add(second, CHANGED, "b");
+  const auto events = compacted(directory, std::move(first), std::move(second));
+
+  std::size_t halves = 0;
+  bool changed = false;
+  for (const auto& event : events) {
+    halves += renamed(event->type) && (event->relativePath == "a" || event->relativePath == "b");
+    changed = changed || (event->relativePath == "b" && event->type == CHANGED);
+  }
+  expect(halves == 2 && changed, "改名对被拆散： " + describe(events));
+}
+
+/// 更晚的删除取代改名移入的一半时，另一半退化为普通删除
+void renameThenDelete(const fs::path& directory) {
+  std::vector<Event::uptr> first, second;
+  add(first, DELETED | RENAMED, "a");
+  add(first, CREATED | RENAMED, "b");
+  add(second, DELETED, "b");
+  const auto events = compacted(directory, std::move(first), std::move(second));
+
+  for (const auto& event : events) {
+    expect(!renamed(event->type), "不应留下孤立的改名记录： " + describe(events));
+  }
+}
+
+/// CHANGED|REPLACED 之后的修改不能抹掉替换
+void replaceThenChange(const fs::path& directory) {
+  std::vector<Event::uptr> first, second;
+  add(first, CHANGED | REPLACED, "f");
+  add(second, CHANGED, "f");
+  const auto events = compacted(directory, std::move(first), std::move(second));
+
+  bool replacement = false;
+  for (const auto& event : events) { replacement = replacement || (event->relativePath == "f" && replaced(event->type)); }
+  expect(replacement, "替换记录被覆盖： " + describe(events));
+}
+}
+
+int main(int argc, char* argv[]) {
+  const fs::path directory = argc > 1 ? argv[1] : fs::temp_directory_path() / ("fw_journal_" + std::to_string(getpid()));
+
+  removeAndRecreate(directory);
+  renameThenChange(directory);
+  renameThenDelete(directory);
+  replaceThenChange(directory);
+
+  fs::remove_all(directory);
+  if (failures == 0) { std::cout << "通过" << std::endl; }
+  return failures == 0 ? 0 : 1;
+}
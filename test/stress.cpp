@@ -0,0 +1,167 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "fw/ConsistencyAuditor.h"
+#include "fw/Filter.h"
+#include "fw/InotifyService.h"
+
+/// 多线程在 tmpfs 上高频增删改名，同时用 ConsistencyAuditor 对账，衡量吞吐调优对正确性的影响。
+/// 用法： fw_stress [根目录] [线程数] [秒数] [分片数] [延迟毫秒]
+namespace {
+using Clock = std::chrono::steady_clock;
+
+/// prefix + 序号；不用 const char* + std::string&&，GCC 12 的 Release 构建会对它误报 -Wrestrict
+std::string numbered(const char* prefix, const std::size_t number) {
+  std::string name(prefix);
+  name += std::to_string(number);
+  return name;
+}
+
+void printReport(const AuditReport& report, const double seconds, const std::size_t operations) {
+  std::cout << "文件 " << report.diskPaths << "  视图 " << report.viewPaths
+    << "  事件/秒 " << static_cast<std::size_t>(static_cast<double>(report.eventsObserved) / seconds)
+    << "  操作/秒 " << static_cast<std::size_t>(static_cast<double>(operations) / seconds)
+    << "  溢出 " << report.overflows << "  待定 " << report.pending
+    << "  丢失 " << report.divergent << " (" << report.divergenceRate * 100 << "%)";
+  for (const auto& [category, count] : report.categories) {
+    std::cout << "  " << auditCategoryToString.at(category) << " " << count;
+  }
+  std::cout << std::endl;
+  for (const auto& sample : report.samples) {
+    std::cout << "    " << sample.string() << std::endl;
+  }
+}
+
+/// 每个线程主要在自己的 w<id> 下操作，少量目录移动到其他线程的子树，跨越分片
+void hammer(const fs::path& root, const std::size_t id, const std::size_t threads,
+            const std::atomic<bool>& running, std::atomic<std::size_t>& operations) {
+  std::mt19937 random(static_cast<unsigned>(id) * 7919u + 1);
+  const auto pick = [&random](const std::size_t bound) {
+    return std::uniform_int_distribution<std::size_t>(0, bound - 1)(random);
+  };
+  const auto directory = [&](const std::size_t owner) {
+    auto path = root / numbered("w", owner);
+    for (std::size_t depth = pick(3); depth > 0; --depth) {
+      path /= numbered("d", pick(4));
+    }
+    return path;
+  };
+  const auto file = [&] { return directory(id) / numbered("f", pick(32)); };
+
+  std::error_code ec;
+  while (running) {
+    const auto operation = pick(100);
+    if (operation < 30) {
+      std::ofstream(file()) << operation;
+    } else if (operation < 55) {
+      std::ofstream(file(), std::ios::app) << operation;
+    } else if (operation < 70) {
+      fs::remove(file(), ec);
+    } else if (operation < 80) {
+      fs::create_directories(directory(id), ec);
+    } else if (operation < 90) {
+      fs::rename(file(), file(), ec);
+    } else if (const auto victim = directory(id); victim.filename() != numbered("w", id)) {
+      /// 顶层 w<id> 是分片的根，只移动或删除它下面的目录
+      if (operation < 95) {
+        fs::rename(victim, directory(pick(threads)) / numbered("m", id), ec);
+      } else {
+        fs::remove_all(victim, ec);
+      }
+    }
+    ++operations;
+  }
+}
+}
+
+int main(int argc, char* argv[]) {
+  const fs::path root = argc > 1 ? argv[1] : "/dev/shm/fw_stress";
+  const std::size_t threads = argc > 2 ? std::stoul(argv[2]) : 8;
+  const auto seconds = argc > 3 ? std::stoul(argv[3]) : 10;
+  const std::size_t shards = argc > 4 ? std::stoul(argv[4]) : 1;
+  const auto latency = std::chrono::milliseconds(argc > 5 ? std::stoul(argv[5]) : 10);
+
+  fs::remove_all(root);
+  for (std::size_t i = 0; i < threads; ++i) {
+    fs::create_directories(root / numbered("w", i));
+  }
+
+  ConsistencyAuditor auditor(root);
+  /// 静止阶段每轮在每个 w<id> 下新建的探针文件名，已经投递到的探针个数及探针事件总数
+  std::mutex probeMutex;
+  std::string probeName;
+  std::size_t probesSeen = 0;
+  std::size_t probeEvents = 0;
+  const auto filter = std::make_shared<Filter>([&](std::vector<Event::uptr>&& events) {
+    auditor.observe(events);
+    std::lock_guard lock(probeMutex);
+    for (const auto& event : events) {
+      if (failed(event->type)) { std::cerr << "错误： " << event->relativePath.string() << std::endl; }
+      if (probeName.empty() || event->relativePath.filename() != probeName) { continue; }
+      ++probeEvents;
+      if (created(event->type)) { ++probesSeen; }
+    }
+  });
+  WatchOptions options;
+  options.inotifyShards = shards;
+  InotifyService service(filter, root, latency, options);
+  if (!service.isWatching()) {
+    std::cerr << "无法监听 " << root.string() << std::endl;
+    return 1;
+  }
+
+  std::atomic<bool> running(true);
+  std::atomic<std::size_t> operations(0);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back(hammer, root, i, threads, std::cref(running), std::ref(operations));
+  }
+
+  auto last = Clock::now();
+  for (std::size_t second = 0; second < seconds; ++second) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const auto now = Clock::now();
+    printReport(auditor.audit(), std::chrono::duration<double>(now - last).count(), operations.exchange(0));
+    last = now;
+  }
+
+  running = false;
+  for (auto& worker : workers) { worker.join(); }
+  /// 等在途事件全部投递：每轮在每个 w<id> 下新建一个探针文件，各分片的读取线程按内核队列顺序处理，
+  /// 探针全部投递后，写探针之前的事件也都已投递；一轮对账只观察到探针自己的事件时说明管线已追上。
+  /// 再写一轮探针把投递进度推过那次扫描，之后一轮没有任何投递的对账确认剩下的差异。
+  /// 内核队列溢出时探针事件也会被丢弃，一轮等不齐就换下一轮
+  const auto settle = [&](const std::size_t round) {
+    {
+      std::lock_guard lock(probeMutex);
+      probeName = numbered("probe", round);
+      probesSeen = 0;
+      probeEvents = 0;
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+      std::ofstream(root / numbered("w", i) / numbered("probe", round)) << round;
+    }
+    for (std::size_t wait = 0; wait < 50; ++wait) {
+      std::this_thread::sleep_for(latency * 4 + std::chrono::milliseconds(100));
+      std::lock_guard lock(probeMutex);
+      if (probesSeen >= threads) { break; }
+    }
+    const auto report = auditor.audit();
+    std::lock_guard lock(probeMutex);
+    return report.eventsObserved <= probeEvents;
+  };
+  std::size_t round = 0;
+  while (round < 120 && !settle(round++)) {}
+  settle(round);
+  std::this_thread::sleep_for(latency * 4 + std::chrono::milliseconds(500));
+  std::cout << "静止后：" << std::endl;
+  const auto final = auditor.audit();
+  printReport(final, 1, 0);
+  return final.divergent == 0 ? 0 : 2;
+}